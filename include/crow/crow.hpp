@@ -35,10 +35,19 @@ SOFTWARE.
 #ifndef NLOHMANN_CROW_HPP
 #define NLOHMANN_CROW_HPP
 
-#include <vector> // vector
-#include <future> // future
+#include <atomic> // atomic
+#include <chrono> // milliseconds, steady_clock
+#include <condition_variable> // condition_variable
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <deque> // deque
+#include <functional> // function
+#include <memory> // shared_ptr, unique_ptr
 #include <mutex> // mutex
 #include <string> //string
+#include <thread> // thread
+#include <vector> // vector
+#include <crow/transports.hpp>
 #include <thirdparty/json/json.hpp>
 
 using json = nlohmann::json;
@@ -48,12 +57,99 @@ using json = nlohmann::json;
  */
 namespace nlohmann
 {
+namespace crow_utilities
+{
+class breadcrumb_buffer;
+struct shared_breadcrumb_buffer;
+struct string_ref;
+class rate_limiter;
+class scope;
+class spool;
+}
+
 /*!
  * @brief a C++ client for Sentry
  */
 class crow
 {
   public:
+    /*!
+     * @brief the level of a breadcrumb
+     *
+     * @since 0.0.7
+     */
+    enum class breadcrumb_level
+    {
+        /// "info" (default)
+        info,
+        /// "debug"
+        debug,
+        /// "warning"
+        warning,
+        /// "error"
+        error,
+        /// "fatal"
+        fatal
+    };
+
+    /*!
+     * @brief what to do with new events when the queue is full
+     *
+     * @since 0.0.7
+     */
+    enum class backpressure_policy
+    {
+        /// drop the new event (default)
+        drop_newest,
+        /// drop the oldest queued events to make room for the new event
+        drop_oldest,
+        /// wait until the sender thread made room, then drop the new event
+        block,
+        /// like drop_newest, but fatal events replace the oldest non-fatal events
+        preserve_fatal
+    };
+
+    /*!
+     * @brief counters of the queue between capturing threads and sender thread
+     *
+     * @since 0.0.7
+     */
+    struct queue_statistics
+    {
+        /// the number of events added to the queue
+        std::size_t accepted = 0;
+        /// the number of events dropped because the queue was full
+        std::size_t dropped = 0;
+    };
+
+    /*!
+     * @brief a guard that discards the context changes made during its lifetime
+     *
+     * @sa push_scope()
+     *
+     * @since 0.0.7
+     */
+    class scope_guard
+    {
+      public:
+        scope_guard(scope_guard&& other) noexcept;
+        scope_guard(const scope_guard&) = delete;
+        scope_guard& operator=(const scope_guard&) = delete;
+        scope_guard& operator=(scope_guard&&) = delete;
+
+        /// discard the context changes the calling thread made since the guard was created
+        ~scope_guard();
+
+      private:
+        friend class crow;
+        scope_guard(crow* client, std::size_t depth) noexcept;
+
+        /// the client to restore the context of (nullptr if moved from)
+        crow* m_client;
+        /// the number of thread scope layers to keep
+        std::size_t m_depth;
+    };
+
     /*!
      * @brief create a client
      *
@@ -61,6 +157,7 @@ class crow
      * @param[in] context an optional attributes object
      * @param[in] sample_rate the sample rate (0.0 .. 1.0, default: 1.0)
      * @param[in] install_handlers whether to install a termination handler (default: off)
+     * @param[in] transport how to deliver events (default: HTTP(S) with libcurl)
      *
      * @throw std::invalid_argument if DNS string is invalid
      * @throw std::invalid_argument if context object contains invalid key
@@ -76,12 +173,22 @@ class crow
      * termination behavior. The termination handler can be installed later
      * with function @ref install_handler().
      *
-     * @since 0.0.1
+     * @since 0.0.1; parameter @a transport since 0.0.7
      */
     explicit crow(const std::string& dsn,
                   const json& context = nullptr,
                   double sample_rate = 1.0,
-                  bool install_handlers = false);
+                  bool install_handlers = false,
+                  std::unique_ptr<crow_transports::transport> transport = nullptr);
+
+    /*!
+     * @brief stop the client
+     *
+     * Calls close() with a timeout of 2 seconds.
+     *
+     * @since 0.0.7
+     */
+    ~crow();
 
     /*!
      * @brief install termination handler to handle uncaught exceptions
@@ -91,6 +198,138 @@ class crow
      */
     void install_handler();
 
+    /*!
+     * @brief set the maximal number of concurrent requests
+     *
+     * @param[in] requests number of events that may be uploaded at the same
+     *            time (default: 1); 0 is treated as 1
+     *
+     * @note All uploads are driven by the single sender thread with libcurl's
+     *       multi interface, so a higher value does not create more threads.
+     *       With more than one concurrent request, events may arrive at
+     *       Sentry in a different order than they were captured.
+     *
+     * @since 0.0.7
+     */
+    void set_max_concurrent_requests(std::size_t requests);
+
+    /*!
+     * @brief send several events with one request
+     *
+     * @param[in] max_events maximal number of events per request (default: 1);
+     *            0 is treated as 1
+     * @param[in] linger maximal time an event waits for the batch to fill up
+     *
+     * With @a max_events greater than 1, queued events are packed into a
+     * single envelope and sent to the `/envelope/` endpoint. A batch is sent
+     * once it is full or its oldest event waited for @a linger. With
+     * @a max_events set to 1, each event is sent to the `/store/` endpoint.
+     *
+     * @note Sentry's own ingestion only accepts one event per envelope. Use
+     *       batches with more events only with endpoints (e.g., relays) that
+     *       accept them.
+     *
+     * @since 0.0.7
+     */
+    void set_batching(std::size_t max_events,
+                      std::chrono::milliseconds linger);
+
+    /*!
+     * @brief set the capacity of the queue of events waiting to be sent
+     *
+     * @param[in] max_events maximal number of queued events (default: 100);
+     *            0 is treated as 1
+     * @param[in] max_bytes maximal size of the queued events' payloads in
+     *            bytes; 0 means no limit (default)
+     *
+     * Events that are currently being sent do not count against the capacity.
+     *
+     * @since 0.0.7
+     */
+    void set_queue_capacity(std::size_t max_events,
+                            std::size_t max_bytes = 0);
+
+    /*!
+     * @brief set what happens to new events when the queue is full
+     *
+     * @param[in] policy the policy (default: backpressure_policy::drop_newest)
+     * @param[in] timeout the maximal time a capturing thread waits with
+     *            backpressure_policy::block
+     *
+     * Events are fatal if they are captured with level "fatal" or are
+     * unhandled exceptions.
+     *
+     * @note With backpressure_policy::block, capturing an event may take up
+     *       to @a timeout.
+     *
+     * @since 0.0.7
+     */
+    void set_backpressure_policy(backpressure_policy policy,
+                                 std::chrono::milliseconds timeout = std::chrono::milliseconds(100));
+
+    /*!
+     * @brief return how many events were accepted and dropped by the queue
+     *
+     * @since 0.0.7
+     */
+    queue_statistics get_queue_statistics() const;
+
+    /*!
+     * @brief buffer events in a file while Sentry is unreachable
+     *
+     * @param[in] path path of the spool file; created if it does not exist
+     * @param[in] max_bytes size of the file's data region in bytes (default: 10 MB)
+     *
+     * Events that cannot be sent because of network errors or server errors
+     * (HTTP status 5xx) are written to a memory-mapped ring buffer file
+     * instead of being lost. The sender thread sends them once its queue is
+     * empty and Sentry is reachable again. Events that are still in the file
+     * when the client is destroyed are sent by the next client using the
+     * same file, for instance after a restart. If the file is full, the
+     * oldest events are discarded. While Sentry rate-limits events, spooled
+     * events are kept and sent after the limit is over. Only records that
+     * are not valid JSON are dropped without being sent.
+     *
+     * @throw std::runtime_error if the file cannot be opened, if it is used
+     *        by another client or process (including a spool set before on
+     *        this client), or if memory-mapped files are not supported on
+     *        this platform
+     *
+     * @since 0.0.7
+     */
+    void set_spool(const std::string& path,
+                   std::size_t max_bytes = 10 * 1024 * 1024);
+
+    /*!
+     * @brief wait until all captured events have been sent
+     *
+     * @param[in] timeout the maximal time to wait
+     * @return the number of events that are still queued or being sent
+     *
+     * Batches are sent right away instead of waiting for their linger time.
+     * Events in the spool file (see set_spool()) are not waited for.
+     *
+     * @since 0.0.7
+     */
+    std::size_t flush(std::chrono::milliseconds timeout);
+
+    /*!
+     * @brief send the captured events and stop the sender thread
+     *
+     * @param[in] timeout the maximal time to wait for the events to be sent
+     * @return the number of events that could not be sent in time
+     *
+     * Events that could not be sent in time are cancelled and written to
+     * the spool file (see set_spool()) if there is one; otherwise they are
+     * lost. Events captured after calling this function are dropped.
+     * Calling the function again returns 0 right away.
+     *
+     * @note The function must not be called by several threads at the same time.
+     *
+     * @since 0.0.7
+     */
+    std::size_t close(std::chrono::milliseconds timeout);
+
     /*!
      * @name event capturing
      * @{
@@ -100,7 +339,8 @@ class crow
      * @brief capture a message
      *
      * @param[in] message the message to capture
-     * @param[in] attributes an optional attributes object
+     * @param[in] attributes an optional attributes object; its "context" and
+     *            "extra" entries are only added to this event
      *
      * @throw std::invalid_argument if context object contains invalid key
      *
@@ -112,7 +352,7 @@ class crow
      * @brief capture an exception
      *
      * @param[in] exception the passed exception
-     * @param[in] context an optional context object
+     * @param[in] context an optional context object that is only added to this event
      * @param[in] handled whether the exception was handled and only reported
      *
      * @throw std::invalid_argument if context object contains invalid key
@@ -123,26 +363,106 @@ class crow
                            const json& context = nullptr,
                            bool handled = true);
 
+    /*!
+     * @brief add file names and line numbers to the stack traces of exceptions
+     *
+     * @param[in] enabled whether to resolve source locations (default: off)
+     *
+     * The locations are read from the DWARF line tables (.debug_line) of the
+     * executable and the shared libraries, so they are only available for
+     * modules built with debug information. Like the function names, they
+     * are resolved by the sender thread before an event is sent; the thread
+     * capturing the exception only records the instruction pointers.
+     *
+     * @note The line tables of a module are read when its first frame is
+     *       resolved and kept until the process ends.
+     *
+     * @since 0.0.7
+     */
+    void set_source_lines(bool enabled);
+
     /*!
      * @brief add a breadcrumb to the current context
      *
      * @param[in] message message for the breadcrumb
      * @param[in] attributes an optional attributes object
      *
+     * @note Only the most recent breadcrumbs are kept, see
+     *       set_breadcrumb_capacity().
+     *
      * @since 0.0.1
      */
     void add_breadcrumb(const std::string& message,
                         const json& attributes = nullptr);
 
+    /*!
+     * @brief add a breadcrumb without building attributes
+     *
+     * @param[in] message message for the breadcrumb
+     * @param[in] level level of the breadcrumb
+     * @param[in] category category of the breadcrumb
+     *
+     * Unlike add_breadcrumb(const std::string&, const json&), this function
+     * does not allocate memory once the breadcrumb buffer of the calling
+     * thread is full and the level and category have been used before.
+     *
+     * @since 0.0.7
+     */
+    void add_breadcrumb(const char* message,
+                        breadcrumb_level level = breadcrumb_level::info,
+                        const char* category = "log");
+
+    /*!
+     * @copydoc add_breadcrumb(const char*, breadcrumb_level, const char*)
+     */
+    void add_breadcrumb(const std::string& message,
+                        breadcrumb_level level,
+                        const char* category = "log");
+
+    /*!
+     * @brief limit the breadcrumbs kept for future events
+     *
+     * @param[in] max_breadcrumbs the maximal number of breadcrumbs (default: 100)
+     * @param[in] max_bytes the maximal size of the messages and serialized data
+     *                      of the breadcrumbs (default: 0, unlimited)
+     *
+     * When a limit is reached, adding a breadcrumb evicts the oldest ones.
+     * Events contain at most @a max_breadcrumbs breadcrumbs.
+     *
+     * @note Each thread stores its breadcrumbs in a buffer of its own, and
+     *       the limits apply to each of these buffers. Events contain the
+     *       most recent breadcrumbs of all buffers, ordered by timestamp.
+     *
+     * @since 0.0.7
+     */
+    void set_breadcrumb_capacity(std::size_t max_breadcrumbs = 100,
+                                 std::size_t max_bytes = 0);
+
     /*!
      * @brief return the id of the last reported event
      *
      * @return event id, or empty string, if no request has been made
      *
+     * @note Waits without a time limit until all captured events have been
+     *       sent, so it blocks as long as Sentry does not answer. Use
+     *       get_last_event_id(std::chrono::milliseconds) to bound the wait.
+     *
      * @since 0.0.2
      */
     std::string get_last_event_id() const;
 
+    /*!
+     * @brief return the id of the last reported event, waiting at most a given time
+     *
+     * @param[in] timeout the maximal time to wait for captured events to be sent
+     * @return event id, or empty string, if no request has been made; if the
+     *         timeout expires, the id of the last event sent so far ("-1" if
+     *         no event id was received yet)
+     *
+     * @since 0.0.7
+     */
+    std::string get_last_event_id(std::chrono::milliseconds timeout) const;
+
     /*!
      * @}
      */
@@ -155,11 +475,11 @@ class crow
     /*!
      * @brief return current context
      *
-     * @return current context
+     * @return a copy of the current context
      *
-     * @since 0.0.3
+     * @since 0.0.3; returns a copy since 0.0.7
      */
-    const json& get_context() const;
+    json get_context() const;
 
     /*!
      * @brief set the code release id
@@ -223,25 +543,275 @@ class crow
      *
      * @post context is in the same state as it was after construction
      *
+     * @note With thread scopes (see set_thread_scopes()), only the changes
+     *       of the calling thread are discarded.
+     *
      * @since 0.0.3
      */
     void clear_context();
 
+    /*!
+     * @brief store context changes per thread
+     *
+     * @param[in] enabled whether context changes only apply to the calling thread (default: off)
+     *
+     * With thread scopes, add_breadcrumb(), merge_context(), the
+     * `add_*_context()` functions, and clear_context() only change the scope
+     * of the calling thread and do not lock the client. Events captured by a
+     * thread contain the global context overlaid with the thread's scope;
+     * breadcrumbs of both are combined. The global context consists of the
+     * changes made before enabling thread scopes and of set_release().
+     *
+     * @since 0.0.7
+     */
+    void set_thread_scopes(bool enabled);
+
+    /*!
+     * @brief layer context changes on top of the current context
+     *
+     * @return a guard that discards all context changes made until it is
+     *         destroyed
+     *
+     * Pushing and popping a scope is O(1): the calling thread's changes are
+     * collected in an additional layer which the guard removes. Like with
+     * thread scopes (see set_thread_scopes()), the changes only apply to
+     * events captured by the calling thread, so threads can push scopes
+     * concurrently, and changes made by other threads are kept.
+     *
+     * @note Breadcrumbs are not part of a scope and are kept.
+     * @note The guard must be destroyed by the thread that created it.
+     *
+     * @since 0.0.7
+     */
+    scope_guard push_scope();
+
     /*!
      * @}
      */
 
   private:
+    /// function processing the HTTP status code (0 for network errors) and the event id of a post
+    using post_handler = std::function<void(int, std::string)>;
+
+    /// an event waiting to be sent
+    struct queued_event
+    {
+        /// the serialized event payload
+        std::string payload;
+        /// whether the event is kept with backpressure_policy::preserve_fatal
+        bool fatal;
+        /// the time the event was added to the queue
+        std::chrono::steady_clock::time_point enqueued;
+        /// the instruction pointers of a stack trace to symbolize before sending
+        std::vector<void*> backtrace;
+        /// the string in the payload to replace by the frames of the stack trace
+        std::string backtrace_marker;
+    };
+
+    /*!
+     * @brief start to POST events to the Sentry sink URL
+     *
+     * @param[in] events payloads to send
+     * @param[in] as_envelope whether to send the events as envelope (otherwise, @a events must contain one event)
+     * @param[in] on_finished function to call with the result
+     *
+     * @note Must only be called from the sender thread, which also executes
+     *       @a on_finished.
+     */
+    void post(const std::vector<std::string>& events, bool as_envelope, post_handler on_finished);
+
+    /*!
+     * @brief process the result of a POST request
+     *
+     * @param[in] sequence the number of the last event in the order of the queue
+     * @param[in] event_id the event id returned by Sentry (empty in case of errors)
+     * @param[in] event_count the number of events sent with the request
+     */
+    void post_finished(std::size_t sequence, std::string event_id, std::size_t event_count);
+
+    /*!
+     * @brief whether the sender thread should send the next batch of events
+     *
+     * @note The caller must hold m_queue_mutex.
+     */
+    bool batch_ready() const;
+
+    /*!
+     * @brief whether a failed request should be repeated later
+     * @param[in] status_code HTTP status code, or 0 for network errors
+     */
+    static bool is_retryable(int status_code);
+
+    /*!
+     * @brief write events that could not be sent to the spool file (if any)
+     * @note Must only be called from the sender thread.
+     */
+    void spool_events(const std::vector<std::string>& events);
+
+    /*!
+     * @brief start sending the oldest event of the spool file
+     * @param[in] lock the lock of m_queue_mutex, which is released while posting
+     * @note Must only be called from the sender thread.
+     */
+    void replay_spooled_event(std::unique_lock<std::mutex>& lock);
+
+    /*!
+     * @brief create the values of a new event that are not part of the global context
+     *
+     * @param[in] scope a snapshot of the global context
+     * @return an object with a new event id, timestamp, and the values of the thread scope
+     */
+    json make_event(const crow_utilities::scope& scope) const;
+
     /*!
-     * @brief POST the payload to the Sentry sink URL
+     * @brief return the values of the calling thread's scope merged with a global scope
      *
-     * @param[in] payload payload to send
-     * @param[in] synchronous whether the payload should be sent immediately
-     * @return result
+     * @param[in] scope a snapshot of the global context
+     * @return the values changed by the thread
      */
-    std::string post(json payload) const;
+    json get_thread_values(const crow_utilities::scope& scope) const;
 
-    void enqueue_post();
+    /*!
+     * @brief return the most recent breadcrumbs for an event
+     *
+     * @return an array of the breadcrumbs of all threads and of the calling
+     *         thread's scope, ordered by timestamp
+     */
+    json get_breadcrumbs() const;
+
+    /*!
+     * @brief store a breadcrumb in the buffer of the calling thread or its scope
+     *
+     * @param[in] message message for the breadcrumb
+     * @param[in] level level of the breadcrumb
+     * @param[in] type type of the breadcrumb
+     * @param[in] category category of the breadcrumb
+     * @param[in] data serialized data of the breadcrumb, or an empty string
+     */
+    void push_breadcrumb(const crow_utilities::string_ref& message,
+                         const crow_utilities::string_ref& level,
+                         const crow_utilities::string_ref& type,
+                         const crow_utilities::string_ref& category,
+                         const crow_utilities::string_ref& data);
+
+    /*!
+     * @brief return the breadcrumb buffer of the calling thread
+     *
+     * @return the buffer, registered with the client on first use
+     */
+    crow_utilities::shared_breadcrumb_buffer& get_thread_breadcrumbs();
+
+    /*!
+     * @brief move the breadcrumbs of ended threads to m_retired_breadcrumbs
+     *
+     * @pre m_breadcrumbs_mutex is locked
+     */
+    void retire_breadcrumb_buffers() const;
+
+    /*!
+     * @brief discard the context changes since a call to push_scope()
+     *
+     * @param[in] depth the number of thread scope layers to keep
+     */
+    void pop_scope(std::size_t depth);
+
+    /*!
+     * @brief return a snapshot of the current context
+     */
+    std::shared_ptr<const crow_utilities::scope> get_scope() const;
+
+    /*!
+     * @brief merge context information with the values of a scope
+     *
+     * @param[in,out] values the values to update; values missing here are
+     *                copied from @a scope before they are updated
+     * @param[in] scope the scope with the current values
+     * @param[in] context the context to add (see merge_context(const json&))
+     *
+     * @throw std::runtime_error if context object contains invalid key
+     */
+    static void merge_context(json& values, const crow_utilities::scope& scope, const json& context);
+
+    /*!
+     * @brief create the context of new clients and of clear_context()
+     */
+    static std::shared_ptr<const crow_utilities::scope> make_default_scope();
+
+    /*!
+     * @brief decide whether to capture an event before any work is spent on it
+     *
+     * @return false if the client is disabled, events are rate-limited, or
+     *         the event is not sampled
+     */
+    bool should_capture() const;
+
+    /*!
+     * @brief add an event to the queue of the sender thread
+     *
+     * @param[in] payload the serialized event
+     * @param[in] fatal whether the event is fatal (see backpressure_policy::preserve_fatal)
+     * @param[in] backtrace the instruction pointers of a stack trace
+     * @param[in] backtrace_marker a string value in @a payload that the
+     *            sender thread replaces by the symbolized frames of @a backtrace
+     */
+    void enqueue_post(std::string payload,
+                      bool fatal,
+                      std::vector<void*> backtrace = {},
+                      std::string backtrace_marker = "");
+
+    /*!
+     * @brief return the final payload of a queued event
+     *
+     * @param[in,out] event an event taken from the queue
+     * @return the payload with the symbolized stack trace
+     *
+     * @note Must only be called from the sender thread.
+     */
+    std::string finish_payload(queued_event& event) const;
+
+    /*!
+     * @brief whether adding @a bytes to the queue would exceed its capacity
+     *
+     * @note The caller must hold m_queue_mutex.
+     */
+    bool queue_full(std::size_t bytes) const;
+
+    /*!
+     * @brief apply the backpressure policy to make room for an event
+     *
+     * @param[in] lock the lock of m_queue_mutex, which may be released while waiting
+     * @param[in] event the new event
+     * @return whether the event fits into the queue
+     */
+    bool make_room(std::unique_lock<std::mutex>& lock, const queued_event& event);
+
+    /*!
+     * @brief remove a queued event without sending it
+     *
+     * @param[in] it the event to remove
+     * @return iterator to the event after the removed one
+     *
+     * @note The caller must hold m_queue_mutex.
+     */
+    std::deque<queued_event>::iterator drop_queued_event(std::deque<queued_event>::iterator it);
+
+    /*!
+     * @brief loop of the sender thread
+     *
+     * Takes events from the queue and sends them until the client is
+     * closed and the queue is empty.
+     */
+    void sender_loop();
+
+    /*!
+     * @brief cancel running requests and queued events
+     *
+     * @param[in] lock the lock of m_queue_mutex, which is released while cancelling
+     * @param[in] sequence the number of the last event taken from the queue
+     *
+     * @note Must only be called from the sender thread.
+     */
+    void abort_events(std::unique_lock<std::mutex>& lock, std::size_t sequence);
 
     /*!
      * @brief termination handler that detects uncaught exceptions
@@ -254,6 +824,10 @@ class crow
     static void new_termination_handler();
 
   private:
+    /// the id of the client, to find its thread scopes
+    const std::uint64_t m_id;
+    /// referenced weakly by the thread-local data of the client, so threads find the data of destroyed clients
+    const std::shared_ptr<const void> m_token;
     /// the sample rate (as integer 0..100)
     const int m_sample_rate;
 
@@ -265,18 +839,84 @@ class crow
     std::string m_secret_key;
     /// the URL to send events to
     std::string m_store_url;
-
-    /// the payload of all events
-    json m_payload = {};
-    /// a mutex to make payload thread-safe
-    std::mutex m_payload_mutex;
-
-    /// a vector of POST jobs
-    mutable std::vector<std::future<std::string>> m_jobs;
-    /// a mutex to make m_jobs thread-safe
-    mutable std::mutex m_jobs_mutex;
+    /// the URL to send envelopes to
+    std::string m_envelope_url;
+    /// the rate limits announced by Sentry
+    std::unique_ptr<crow_utilities::rate_limiter> m_rate_limiter;
+    /// the transport used by the sender thread
+    std::unique_ptr<crow_transports::transport> m_transport;
+
+    /// the context after construction and clear_context()
+    const std::shared_ptr<const crow_utilities::scope> m_default_scope;
+    /// the current context, shared with the events being created
+    std::shared_ptr<const crow_utilities::scope> m_scope;
+    /// a mutex to make m_scope thread-safe
+    mutable std::mutex m_payload_mutex;
+    /// whether context changes are stored per thread
+    std::atomic<bool> m_thread_scopes {false};
+    /// whether stack traces contain file names and line numbers
+    std::atomic<bool> m_source_lines {false};
+    /// the breadcrumbs added without thread scopes, one buffer per thread
+    mutable std::vector<std::shared_ptr<crow_utilities::shared_breadcrumb_buffer>> m_breadcrumb_buffers;
+    /// the breadcrumbs of the threads that ended
+    std::unique_ptr<crow_utilities::breadcrumb_buffer> m_retired_breadcrumbs;
+    /// a mutex to make m_breadcrumb_buffers and m_retired_breadcrumbs thread-safe
+    mutable std::mutex m_breadcrumbs_mutex;
+    /// the maximal number of breadcrumbs
+    std::atomic<std::size_t> m_max_breadcrumbs {100};
+    /// the maximal size of the text of the breadcrumbs (0: no limit)
+    std::atomic<std::size_t> m_max_breadcrumb_bytes {0};
+
+    /// the events waiting to be sent by the sender thread
+    std::deque<queued_event> m_queue;
+    /// the sum of the payload sizes in m_queue
+    std::size_t m_queued_bytes = 0;
+    /// the maximal number of events waiting in the queue
+    std::size_t m_max_queue_events = 100;
+    /// the maximal sum of payload sizes in the queue (0: no limit)
+    std::size_t m_max_queue_bytes = 0;
+    /// what to do with new events if the queue is full
+    backpressure_policy m_backpressure_policy = backpressure_policy::drop_newest;
+    /// the maximal time to wait with backpressure_policy::block
+    std::chrono::milliseconds m_backpressure_timeout {100};
+    /// how many events were accepted and dropped by the queue
+    queue_statistics m_queue_statistics;
+    /// the number of events that are queued or currently being sent
+    std::size_t m_pending_events = 0;
+    /// whether the sender thread should stop once the queue is empty
+    bool m_stop_sender = false;
+    /// whether the sender thread should cancel all events and stop
+    bool m_abort_sender = false;
+    /// whether the sender thread is in transport::perform() and needs transport::wakeup() for new events
+    bool m_sender_performing = false;
+    /// whether close() was called; new events are dropped
+    bool m_closed = false;
+    /// the number of threads waiting in flush()
+    std::size_t m_flush_requests = 0;
+    /// the maximal number of events the sender thread uploads at the same time
+    std::size_t m_max_concurrent_requests = 1;
+    /// the maximal number of events sent with one request
+    std::size_t m_max_batch_size = 1;
+    /// the maximal time an event waits for its batch to be filled
+    std::chrono::milliseconds m_batch_linger {0};
+    /// the file to buffer events that could not be sent (may be null)
+    std::shared_ptr<crow_utilities::spool> m_spool;
+    /// the earliest time to send spooled events again (only used by the sender thread)
+    std::chrono::steady_clock::time_point m_spool_retry;
+    /// the number of the event whose id is stored in m_last_event_id
+    std::size_t m_last_event_sequence = 0;
+    /// a mutex to make m_queue and the variables above thread-safe
+    mutable std::mutex m_queue_mutex;
+    /// notifies the sender thread about new events or a stop request
+    std::condition_variable m_queue_filled;
+    /// notifies waiting threads that the sender thread processed an event
+    mutable std::condition_variable m_queue_processed;
+    /// notifies capturing threads that the sender thread took events from the queue
+    std::condition_variable m_queue_space;
+    /// the thread sending the queued events
+    std::thread m_sender;
     /// a cache for the last event id
-    mutable std::string m_last_event_id = "-1";
+    std::string m_last_event_id = "-1";
     /// whether a post has been made already
     bool m_posts = false;
 
@@ -284,9 +924,6 @@ class crow
     std::terminate_handler existing_termination_handler = nullptr;
     /// a pointer to the last client (used for termination handling)
     static crow* m_client_that_installed_termination_handler;
-
-    /// the maximal number of running jobs
-    static constexpr std::size_t m_maximal_jobs = 10;
 };
 
 }
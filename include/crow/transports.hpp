@@ -0,0 +1,371 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file transports.hpp
+ * @brief ways to deliver events to Sentry
+ */
+
+#ifndef NLOHMANN_CROW_TRANSPORTS_HPP
+#define NLOHMANN_CROW_TRANSPORTS_HPP
+
+#include <chrono> // milliseconds
+#include <condition_variable> // condition_variable
+#include <cstddef> // size_t
+#include <fstream> // ofstream
+#include <functional> // function
+#include <map> // map
+#include <memory> // unique_ptr
+#include <mutex> // mutex
+#include <string> // string
+#include <utility> // pair
+#include <vector> // vector
+
+namespace nlohmann
+{
+/*!
+ * @brief transports to deliver events from the client to Sentry
+ */
+namespace crow_transports
+{
+
+/*!
+ * @brief a request to deliver events
+ * @since 0.0.7
+ */
+struct request
+{
+    /// the URL of the Sentry endpoint (store or envelope)
+    std::string url;
+    /// the value of the X-Sentry-Auth header
+    std::string auth;
+    /// the value of the Content-Type header
+    std::string content_type;
+    /// the serialized event or envelope
+    std::string body;
+};
+
+/*!
+ * @brief the result of a request
+ * @since 0.0.7
+ */
+struct response
+{
+    /// the HTTP status code, or 0 if the request could not be delivered
+    int status_code = 0;
+    /// the response body
+    std::string body;
+    /// the response headers with lowercase names
+    std::map<std::string, std::string> headers;
+
+    /*!
+     * @brief return the value of a response header
+     * @param[in] name lowercase header name
+     * @return header value or empty string if the header is missing
+     */
+    std::string header(const std::string& name) const
+    {
+        const auto it = headers.find(name);
+        return it != headers.end() ? it->second : "";
+    }
+};
+
+/*!
+ * @brief interface of all transports
+ *
+ * The client's sender thread starts requests with send() and calls
+ * perform() while requests are in flight. Transports report results by
+ * calling the completion handler of a request from perform() or abort().
+ *
+ * @note Except wakeup(), all member functions are called from the sender
+ *       thread only.
+ *
+ * @since 0.0.7
+ */
+class transport
+{
+  public:
+    /// function to call with the result of a request
+    using completion_handler = std::function<void(response)>;
+
+    virtual ~transport() = default;
+
+    /*!
+     * @brief start a request
+     * @param[in] req the request
+     * @param[in] on_completion function to call once the request is done
+     * @throw std::runtime_error if the request cannot be started
+     */
+    virtual void send(request req, completion_handler on_completion) = 0;
+
+    /*!
+     * @brief make progress on requests in flight
+     * @param[in] timeout maximal time to wait for activity
+     */
+    virtual void perform(std::chrono::milliseconds timeout) = 0;
+
+    /*!
+     * @brief return the number of requests whose handler was not called yet
+     */
+    virtual std::size_t in_flight() const = 0;
+
+    /*!
+     * @brief interrupt a perform() call that waits for activity
+     * @note May be called from any thread.
+     */
+    virtual void wakeup() {}
+
+    /*!
+     * @brief cancel all requests in flight
+     *
+     * The completion handlers are called with status code 0.
+     */
+    virtual void abort() = 0;
+};
+
+/*!
+ * @brief base class for transports that deliver a request right away
+ *
+ * send() calls deliver() and keeps the result until the next call of
+ * perform() or abort(), which calls the completion handlers.
+ *
+ * @since 0.0.7
+ */
+class synchronous_transport : public transport
+{
+  public:
+    void send(request req, completion_handler on_completion) override;
+    void perform(std::chrono::milliseconds timeout) override;
+    std::size_t in_flight() const override;
+    void abort() override;
+
+  protected:
+    /*!
+     * @brief deliver a request
+     * @param[in] req the request
+     * @return the result
+     */
+    virtual response deliver(const request& req) = 0;
+
+  private:
+    /// the results whose completion handlers were not called yet
+    std::vector<std::pair<response, completion_handler>> m_completed;
+};
+
+/*!
+ * @brief send events to Sentry via HTTP(S) with libcurl (default)
+ *
+ * Requests are gzip-compressed and sent concurrently with libcurl's multi
+ * interface. DNS lookups, TLS sessions, and connections are reused.
+ *
+ * @since 0.0.7
+ */
+class http_transport : public transport
+{
+  public:
+    http_transport();
+    ~http_transport() override;
+
+    void send(request req, completion_handler on_completion) override;
+    void perform(std::chrono::milliseconds timeout) override;
+    std::size_t in_flight() const override;
+    void wakeup() override;
+    void abort() override;
+
+  protected:
+    /*!
+     * @brief create a transport that connects to a Unix domain socket
+     * @param[in] unix_socket_path the path of the socket
+     */
+    explicit http_transport(std::string unix_socket_path);
+
+  private:
+    struct impl;
+    /// the libcurl handles
+    std::unique_ptr<impl> m_impl;
+};
+
+/*!
+ * @brief send events via HTTP to a local relay listening on a Unix domain socket
+ *
+ * The requests are the same as with http_transport, including the host name
+ * of the DSN, but the connection is made to the given socket. This moves
+ * TLS and network latency from the process to the relay: requests are
+ * always sent as plain HTTP, also for DSNs with scheme "https".
+ *
+ * @note Requires libcurl 7.40.0 or later; send() throws otherwise.
+ *
+ * @since 0.0.7
+ */
+class unix_socket_transport : public http_transport
+{
+  public:
+    /*!
+     * @brief create a transport
+     * @param[in] path the path of the relay's socket
+     */
+    explicit unix_socket_transport(std::string path);
+};
+
+/*!
+ * @brief append events to a file for a log shipper
+ *
+ * Each request body is written to the file, followed by a newline. With
+ * single events, this gives a file with one JSON object per line; with
+ * batching, each envelope is written. When the file would exceed its
+ * maximal size, it is renamed to `path.1`, older files are renamed to
+ * `path.2` and so on, and the oldest file is removed.
+ *
+ * The response has status code 200 without an event id, so
+ * crow::get_last_event_id() does not change. If writing fails, the
+ * response has status code 0, and the events are spooled if the client has
+ * a spool file.
+ *
+ * @since 0.0.7
+ */
+class file_transport : public synchronous_transport
+{
+  public:
+    /*!
+     * @brief create a transport
+     *
+     * @param[in] path the path of the file; events are appended if it exists
+     * @param[in] max_bytes the size that triggers a rotation (default: 10 MB)
+     * @param[in] max_files the number of rotated files to keep (default: 5)
+     */
+    explicit file_transport(std::string path,
+                            std::size_t max_bytes = 10 * 1024 * 1024,
+                            std::size_t max_files = 5);
+
+  protected:
+    response deliver(const request& req) override;
+
+  private:
+    /// rename the current file and start a new one
+    void rotate();
+
+    /// the path of the current file
+    const std::string m_path;
+    /// the size that triggers a rotation
+    const std::size_t m_max_bytes;
+    /// the number of rotated files to keep
+    const std::size_t m_max_files;
+    /// the current file
+    std::ofstream m_file;
+    /// the size of the current file
+    std::size_t m_size = 0;
+};
+
+/*!
+ * @brief keep requests in memory, for instance to test code using the client
+ *
+ * Requests are recorded and answered with a configurable response. By
+ * default, the response has status code 200 and a body with the event id
+ * of the last event in the request, like Sentry's. The recorded requests
+ * can be inspected from any thread.
+ *
+ * @since 0.0.7
+ */
+class memory_transport : public transport
+{
+  public:
+    void send(request req, completion_handler on_completion) override;
+    void perform(std::chrono::milliseconds timeout) override;
+    std::size_t in_flight() const override;
+    void wakeup() override;
+    void abort() override;
+
+    /*!
+     * @brief set the response to following requests
+     *
+     * @param[in] status_code the status code; 0 simulates a network error
+     * @param[in] headers the response headers with lowercase names
+     */
+    void set_response(int status_code,
+                      std::map<std::string, std::string> headers = {});
+
+    /*!
+     * @brief keep requests in flight to simulate an unresponsive server
+     *
+     * @param[in] held whether perform() keeps requests in flight
+     */
+    void hold(bool held);
+
+    /*!
+     * @brief return the recorded requests
+     */
+    std::vector<request> requests() const;
+
+    /*!
+     * @brief return the number of recorded requests
+     */
+    std::size_t request_count() const;
+
+    /*!
+     * @brief return the number of wakeup() calls
+     */
+    std::size_t wakeup_count() const;
+
+    /*!
+     * @brief return the number of perform() calls
+     */
+    std::size_t perform_count() const;
+
+    /*!
+     * @brief remove the recorded requests
+     */
+    void clear();
+
+  private:
+    /// a mutex for the members below
+    mutable std::mutex m_mutex;
+    /// notifies perform() about wakeup() and hold()
+    std::condition_variable m_wakeup;
+    /// whether wakeup() was called since the last perform()
+    bool m_woken = false;
+    /// the number of wakeup() calls
+    std::size_t m_wakeup_count = 0;
+    /// the number of perform() calls
+    std::size_t m_perform_count = 0;
+    /// whether perform() keeps requests in flight
+    bool m_held = false;
+    /// the status code of following responses
+    int m_status_code = 200;
+    /// the headers of following responses
+    std::map<std::string, std::string> m_headers;
+    /// the recorded requests
+    std::vector<request> m_requests;
+    /// the responses whose completion handlers were not called yet
+    std::vector<std::pair<response, completion_handler>> m_in_flight;
+};
+
+}
+}
+
+#endif
@@ -1,24 +1,110 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cctype>
 #include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 #include <curl/curl.h>
 #include <zlib.h>
 #include "thirdparty/json/json.hpp"
 
+/*!
+ * @brief a share handle for DNS cache, TLS sessions, and connections
+ *
+ * Easy handles that use the same share object reuse resolved host names,
+ * TLS session ids, and (with libcurl 7.57.0 or later) open connections.
+ * The share object may be used by easy handles in different threads and
+ * must outlive all of them.
+ */
+class curl_share
+{
+  public:
+    curl_share() : m_share(curl_share_init())
+    {
+        assert(m_share);
+
+        curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, &lock_callback);
+        curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, &unlock_callback);
+        curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+        curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
+
+    ~curl_share()
+    {
+        curl_share_cleanup(m_share);
+    }
+
+    curl_share(const curl_share&) = delete;
+    curl_share& operator=(const curl_share&) = delete;
+
+    CURLSH* get() const noexcept
+    {
+        return m_share;
+    }
+
+  private:
+    static void lock_callback(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+    {
+        static_cast<curl_share*>(userptr)->m_mutexes[data % CURL_LOCK_DATA_LAST].lock();
+    }
+
+    static void unlock_callback(CURL*, curl_lock_data data, void* userptr)
+    {
+        static_cast<curl_share*>(userptr)->m_mutexes[data % CURL_LOCK_DATA_LAST].unlock();
+    }
+
+  private:
+    CURLSH* const m_share;
+    std::mutex m_mutexes[CURL_LOCK_DATA_LAST];
+};
+
+/*!
+ * @brief a reusable easy handle
+ *
+ * The handle keeps its connection alive between calls to post(), so only
+ * the first request to a host pays for DNS lookup, TCP connect, and TLS
+ * handshake.
+ */
 class curl_wrapper
 {
   public:
     class response
     {
       public:
-        response(std::string d, int sc)
+        response(std::string d, int sc, std::map<std::string, std::string> h = {})
             : data(std::move(d))
             , status_code(sc)
+            , headers(std::move(h))
         {}
 
         std::string data;
         int status_code;
+        /// response headers with lowercase names
+        std::map<std::string, std::string> headers;
+
+        /*!
+         * @brief return the value of a response header
+         * @param[in] name lowercase header name
+         * @return header value or empty string if the header is missing
+         */
+        std::string header(const std::string& name) const
+        {
+            const auto it = headers.find(name);
+            return it != headers.end() ? it->second : "";
+        }
 
         nlohmann::json json()
         {
@@ -27,63 +113,127 @@ class curl_wrapper
     };
 
   public:
-    curl_wrapper() : m_curl(curl_easy_init())
+    explicit curl_wrapper(const curl_share* share = nullptr) : m_curl((global_init(), curl_easy_init()))
     {
         assert(m_curl);
 
         //set_option(CURLOPT_VERBOSE, 1L);
         set_option(CURLOPT_SSL_VERIFYPEER, 0L);
+
+        // keep idle connections alive between posts
+        set_option(CURLOPT_TCP_KEEPALIVE, 1L);
+        set_option(CURLOPT_TCP_KEEPIDLE, 60L);
+        set_option(CURLOPT_TCP_KEEPINTVL, 30L);
+
+        if (share != nullptr)
+        {
+            set_option(CURLOPT_SHARE, share->get());
+        }
     }
 
     ~curl_wrapper()
     {
+        curl_slist_free_all(m_request_headers);
         curl_slist_free_all(m_headers);
         curl_easy_cleanup(m_curl);
     }
 
+    curl_wrapper(const curl_wrapper&) = delete;
+    curl_wrapper& operator=(const curl_wrapper&) = delete;
+
     response post(const std::string& url, const nlohmann::json& payload, const bool compress = false)
     {
-        set_header("Content-Type: application/json");
-        return post(url, payload.dump(), compress);
+        return post(url, payload.dump(), compress, "Content-Type: application/json");
+    }
+
+    response post(const std::string& url, const std::string& data, const bool compress = false,
+                  const char* content_type_header = nullptr)
+    {
+        prepare_post(url, data, compress, content_type_header);
+
+        auto res = curl_easy_perform(m_curl);
+
+        if (res != CURLE_OK)
+        {
+            std::string error_msg = std::string("curl_easy_perform() failed: ") + curl_easy_strerror(res);
+            throw std::runtime_error(error_msg);
+        }
+
+        return get_response();
     }
 
-    response post(const std::string& url, const std::string& data, const bool compress = false)
+    /*!
+     * @brief set up a POST request without performing it
+     *
+     * @param[in] url the URL to post to
+     * @param[in] data the data to post (copied, so it may be destroyed afterwards)
+     * @param[in] compress whether to gzip-compress the data
+     * @param[in] content_type_header an optional Content-Type header line
+     *
+     * @note Used by curl_multi_wrapper; use get_response() after the transfer.
+     */
+    void prepare_post(const std::string& url, const std::string& data, const bool compress = false,
+                      const char* content_type_header = nullptr)
     {
-        std::string c_data;
+        // the headers of this request are the headers set with set_header()
+        // plus the content headers
+        curl_slist_free_all(m_request_headers);
+        m_request_headers = nullptr;
+        for (auto header = m_headers; header != nullptr; header = header->next)
+        {
+            m_request_headers = curl_slist_append(m_request_headers, header->data);
+        }
+        if (content_type_header != nullptr)
+        {
+            m_request_headers = curl_slist_append(m_request_headers, content_type_header);
+        }
 
         if (compress)
         {
-            c_data = compress_string(data);
+            m_post_data = compress_string(data);
 
-            set_header("Content-Encoding: gzip");
-            const std::string size_header = "Content-Length: " + std::to_string(c_data.size());
-            set_header(size_header.c_str());
-            set_option(CURLOPT_POSTFIELDS, c_data.c_str());
-            set_option(CURLOPT_POSTFIELDSIZE, c_data.size());
+            m_request_headers = curl_slist_append(m_request_headers, "Content-Encoding: gzip");
+            const std::string size_header = "Content-Length: " + std::to_string(m_post_data.size());
+            m_request_headers = curl_slist_append(m_request_headers, size_header.c_str());
         }
         else
         {
-            set_option(CURLOPT_POSTFIELDS, data.c_str());
-            set_option(CURLOPT_POSTFIELDSIZE, data.size());
+            m_post_data = data;
         }
 
+        // libcurl does not copy the data, so it must live until the transfer is done
+        set_option(CURLOPT_POSTFIELDS, m_post_data.c_str());
+        set_option(CURLOPT_POSTFIELDSIZE, static_cast<long>(m_post_data.size()));
+        set_option(CURLOPT_HTTPHEADER, m_request_headers);
         set_option(CURLOPT_URL, url.c_str());
-        set_option(CURLOPT_POST, 1);
+        set_option(CURLOPT_POST, 1L);
         set_option(CURLOPT_WRITEFUNCTION, &write_callback);
         set_option(CURLOPT_WRITEDATA, &string_buffer);
+        set_option(CURLOPT_HEADERFUNCTION, &header_callback);
+        set_option(CURLOPT_HEADERDATA, &m_response_headers);
+        string_buffer.clear();
+        m_response_headers.clear();
+    }
 
-        auto res = curl_easy_perform(m_curl);
-
-        if (res != CURLE_OK)
-        {
-            std::string error_msg = std::string("curl_easy_perform() failed: ") + curl_easy_strerror(res);
-            throw std::runtime_error(error_msg);
-        }
-
-        int status_code;
+    /*!
+     * @brief return the response of the last performed request
+     * @return response body and status code
+     */
+    response get_response()
+    {
+        // CURLINFO_RESPONSE_CODE expects a pointer to long
+        long status_code = 0;
         curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &status_code);
 
-        return {std::move(string_buffer), status_code};
+        return {std::move(string_buffer), static_cast<int>(status_code), std::move(m_response_headers)};
+    }
+
+    /*!
+     * @brief return the underlying easy handle
+     */
+    CURL* get() const noexcept
+    {
+        return m_curl;
     }
 
     template<typename T>
@@ -92,13 +242,38 @@ class curl_wrapper
         return curl_easy_setopt(m_curl, option, parameter);
     }
 
+    /*!
+     * @brief add a header to all following requests
+     * @param[in] header the header line
+     */
     void set_header(const char* header)
     {
         m_headers = curl_slist_append(m_headers, header);
-        set_option(CURLOPT_HTTPHEADER, m_headers);
+    }
+
+    /*!
+     * @brief remove all headers added with set_header()
+     */
+    void clear_headers()
+    {
+        curl_slist_free_all(m_headers);
+        m_headers = nullptr;
     }
 
   private:
+    /*!
+     * @brief initialize libcurl once per process
+     *
+     * @note curl_easy_init() would initialize libcurl implicitly, but this
+     *       is not thread-safe. We never call curl_global_cleanup(), because
+     *       handles in static objects may outlive any cleanup point.
+     */
+    static void global_init()
+    {
+        static const CURLcode result = curl_global_init(CURL_GLOBAL_ALL);
+        static_cast<void>(result);
+    }
+
     static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
     {
         assert(userdata);
@@ -106,6 +281,36 @@ class curl_wrapper
         return size * nmemb;
     }
 
+    static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+    {
+        assert(userdata);
+        auto& headers = *static_cast<std::map<std::string, std::string>*>(userdata);
+        const std::string line(buffer, size * nitems);
+
+        if (line.compare(0, 5, "HTTP/") == 0)
+        {
+            // status line of a new response (e.g., after "100 Continue")
+            headers.clear();
+        }
+        else
+        {
+            const auto colon = line.find(':');
+            if (colon != std::string::npos)
+            {
+                std::string name = line.substr(0, colon);
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+                const auto value_begin = line.find_first_not_of(" \t", colon + 1);
+                const auto value_end = line.find_last_not_of(" \t\r\n");
+                headers[name] = (value_begin != std::string::npos and value_end >= value_begin)
+                                ? line.substr(value_begin, value_end - value_begin + 1)
+                                : "";
+            }
+        }
+
+        return size * nitems;
+    }
+
     /*!
      * @brief gzip compress a string
      *
@@ -169,5 +374,203 @@ class curl_wrapper
   private:
     CURL* const m_curl;
     struct curl_slist* m_headers = nullptr;
+    struct curl_slist* m_request_headers = nullptr;
+    std::string m_post_data;
     std::string string_buffer;
+    std::map<std::string, std::string> m_response_headers;
+};
+
+/*!
+ * @brief an event loop for concurrent transfers using the multi interface
+ *
+ * A single thread can drive many uploads: post() only starts a transfer and
+ * perform() makes progress on all running transfers, calling the completion
+ * callback of every finished transfer. Finished easy handles are kept in a
+ * pool and reused for later posts, including their open connections.
+ *
+ * @note Except wakeup(), all member functions must be called from the same
+ *       thread. The callbacks are executed by perform().
+ */
+class curl_multi_wrapper
+{
+  public:
+    /*!
+     * @brief completion callback
+     *
+     * The first parameter is the transfer result; the response is only
+     * meaningful if it is CURLE_OK.
+     */
+    using callback = std::function<void(CURLcode, curl_wrapper::response)>;
+
+    explicit curl_multi_wrapper(const curl_share* share = nullptr)
+        : m_share(share)
+        , m_multi(curl_multi_init())
+    {
+        assert(m_multi);
+    }
+
+    ~curl_multi_wrapper()
+    {
+        for (auto& transfer : m_transfers)
+        {
+            curl_multi_remove_handle(m_multi, transfer.first);
+        }
+        m_transfers.clear();
+        m_idle_handles.clear();
+        curl_multi_cleanup(m_multi);
+    }
+
+    curl_multi_wrapper(const curl_multi_wrapper&) = delete;
+    curl_multi_wrapper& operator=(const curl_multi_wrapper&) = delete;
+
+    /*!
+     * @brief return an easy handle to configure and pass to post()
+     * @return an idle handle from the pool or a new handle
+     */
+    std::unique_ptr<curl_wrapper> acquire_handle()
+    {
+        if (m_idle_handles.empty())
+        {
+            return std::unique_ptr<curl_wrapper>(new curl_wrapper(m_share));
+        }
+
+        auto result = std::move(m_idle_handles.back());
+        m_idle_handles.pop_back();
+        return result;
+    }
+
+    /*!
+     * @brief start a POST request
+     *
+     * @param[in] handle the handle to use (see acquire_handle())
+     * @param[in] url the URL to post to
+     * @param[in] data the data to post
+     * @param[in] compress whether to gzip-compress the data
+     * @param[in] content_type_header an optional Content-Type header line
+     * @param[in] on_completion function to call once the transfer is done
+     */
+    void post(std::unique_ptr<curl_wrapper> handle,
+              const std::string& url, const std::string& data, const bool compress,
+              const char* content_type_header, callback on_completion)
+    {
+        assert(handle);
+        handle->prepare_post(url, data, compress, content_type_header);
+
+        CURL* const easy = handle->get();
+        const auto res = curl_multi_add_handle(m_multi, easy);
+        if (res != CURLM_OK)
+        {
+            m_idle_handles.push_back(std::move(handle));
+            throw std::runtime_error(std::string("curl_multi_add_handle() failed: ") + curl_multi_strerror(res));
+        }
+
+        m_transfers[easy] = std::make_pair(std::move(handle), std::move(on_completion));
+    }
+
+    /*!
+     * @brief make progress on all running transfers
+     *
+     * Waits at most @a timeout_ms milliseconds for activity (or a call to
+     * wakeup()) and executes the callbacks of all finished transfers.
+     *
+     * @param[in] timeout_ms maximal time to wait for activity
+     * @return number of transfers still running
+     */
+    std::size_t perform(const int timeout_ms)
+    {
+        int running = 0;
+        curl_multi_perform(m_multi, &running);
+
+#if LIBCURL_VERSION_NUM >= 0x074200
+        curl_multi_poll(m_multi, nullptr, 0, timeout_ms, nullptr);
+#else
+        curl_multi_wait(m_multi, nullptr, 0, timeout_ms, nullptr);
+#endif
+
+        curl_multi_perform(m_multi, &running);
+
+        int messages = 0;
+        while (CURLMsg* message = curl_multi_info_read(m_multi, &messages))
+        {
+            if (message->msg != CURLMSG_DONE)
+            {
+                continue;
+            }
+
+            CURL* const easy = message->easy_handle;
+            const CURLcode result = message->data.result;
+            curl_multi_remove_handle(m_multi, easy);
+
+            auto transfer = m_transfers.find(easy);
+            assert(transfer != m_transfers.end());
+            auto handle = std::move(transfer->second.first);
+            auto on_completion = std::move(transfer->second.second);
+            m_transfers.erase(transfer);
+
+            auto response = (result == CURLE_OK)
+                            ? handle->get_response()
+                            : curl_wrapper::response("", 0);
+            m_idle_handles.push_back(std::move(handle));
+
+            if (on_completion)
+            {
+                on_completion(result, std::move(response));
+            }
+        }
+
+        return m_transfers.size();
+    }
+
+    /*!
+     * @brief cancel all running transfers
+     *
+     * The callbacks of the cancelled transfers are executed with
+     * CURLE_ABORTED_BY_CALLBACK.
+     */
+    void abort()
+    {
+        auto transfers = std::move(m_transfers);
+        m_transfers.clear();
+
+        for (auto& transfer : transfers)
+        {
+            curl_multi_remove_handle(m_multi, transfer.first);
+            m_idle_handles.push_back(std::move(transfer.second.first));
+        }
+
+        for (auto& transfer : transfers)
+        {
+            if (transfer.second.second)
+            {
+                transfer.second.second(CURLE_ABORTED_BY_CALLBACK, curl_wrapper::response("", 0));
+            }
+        }
+    }
+
+    /*!
+     * @brief return the number of running transfers
+     */
+    std::size_t in_flight() const noexcept
+    {
+        return m_transfers.size();
+    }
+
+    /*!
+     * @brief interrupt a perform() call that waits for activity
+     *
+     * @note May be called from any thread. Without curl_multi_wakeup()
+     *       (libcurl < 7.68.0), perform() returns after its timeout.
+     */
+    void wakeup()
+    {
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_wakeup(m_multi);
+#endif
+    }
+
+  private:
+    const curl_share* const m_share;
+    CURLM* const m_multi;
+    std::map<CURL*, std::pair<std::unique_ptr<curl_wrapper>, callback>> m_transfers;
+    std::vector<std::unique_ptr<curl_wrapper>> m_idle_handles;
 };
@@ -32,14 +32,26 @@ SOFTWARE.
  * @brief implementation of class crow
  */
 
+#include <algorithm> // max, nth_element, stable_sort
+#include <atomic> // atomic
+#include <cassert> // assert
+#include <cstdint> // uint64_t
 #include <exception> // current_exception, exception, get_terminate, rethrow_exception, set_terminate
+#include <iterator> // next
+#include <limits> // numeric_limits
+#include <map> // map
 #include <regex> // regex, regex_match, smatch
 #include <stdexcept> // invalid_argument
 #include <sstream> // stringstream
+#include <thread> // this_thread, thread
+#include <vector> // vector
 #include <crow/crow.hpp>
+#include <src/crow_breadcrumbs.hpp>
 #include <src/crow_config.hpp>
+#include <src/crow_rate_limiter.hpp>
+#include <src/crow_scope.hpp>
+#include <src/crow_spool.hpp>
 #include <src/crow_utilities.hpp>
-#include <thirdparty/curl_wrapper/curl_wrapper.hpp>
 #include <thirdparty/json/json.hpp>
 
 using json = nlohmann::json;
@@ -48,14 +60,185 @@ namespace nlohmann
 {
 class crow;
 
+namespace
+{
+/// the time to wait before sending spooled events after a failed request
+const std::chrono::seconds spool_retry_delay(10);
+
+/// the time to wait for events to be sent when the client is destroyed or the program terminates
+const std::chrono::milliseconds shutdown_timeout(2000);
+
+/// the source of client ids
+std::atomic<std::uint64_t> next_client_id(0);
+
+/// the context changes of a thread
+struct thread_scope
+{
+    /// expires when the client is destroyed
+    std::weak_ptr<const void> client;
+    /// the layers of context changes; push_scope() adds a layer
+    std::vector<json> layers;
+    /// whether the first layer holds the changes made outside push_scope(), which only apply with thread scopes
+    bool base_layer = false;
+    /// the breadcrumbs added by the thread
+    crow_utilities::breadcrumb_buffer breadcrumbs;
+};
+
+/// the breadcrumb buffer of a thread
+struct thread_breadcrumb_buffer
+{
+    /// expires when the client is destroyed
+    std::weak_ptr<const void> client;
+    /// the buffer; the client also holds it, so it outlives the thread
+    std::shared_ptr<crow_utilities::shared_breadcrumb_buffer> buffer;
+};
+
+/*!
+ * @brief the thread scopes of the clients used by this thread, by client id
+ *
+ * @note Entries of destroyed clients are removed by the destructor on the
+ *       destroying thread, and by get_thread_entry() on the other threads.
+ */
+thread_local std::map<std::uint64_t, thread_scope> thread_scopes;
+
+/*!
+ * @brief the breadcrumb buffers of the clients used by this thread, by client id
+ *
+ * @note Entries of destroyed clients are removed like those of thread_scopes.
+ */
+thread_local std::map<std::uint64_t, thread_breadcrumb_buffer> thread_breadcrumbs;
+
+/*!
+ * @brief return the entry of a client in a thread-local map, adding it if needed
+ *
+ * @param[in,out] entries thread_scopes or thread_breadcrumbs
+ * @param[in] client_id the id of the client
+ * @param[in] client_token the token of the client, which expires when it is destroyed
+ * @return the entry of the client
+ *
+ * @note Adding an entry discards the entries of destroyed clients, so
+ *       long-running threads do not accumulate them.
+ */
+template<typename Entry>
+Entry& get_thread_entry(std::map<std::uint64_t, Entry>& entries,
+                        const std::uint64_t client_id,
+                        const std::shared_ptr<const void>& client_token)
+{
+    auto it = entries.find(client_id);
+    if (it != entries.end())
+    {
+        return it->second;
+    }
+
+    for (auto stale = entries.begin(); stale != entries.end();)
+    {
+        if (stale->second.client.expired())
+        {
+            stale = entries.erase(stale);
+        }
+        else
+        {
+            ++stale;
+        }
+    }
+
+    it = entries.emplace(client_id, Entry()).first;
+    it->second.client = client_token;
+    return it->second;
+}
+
+/*!
+ * @brief return a string attribute of a breadcrumb
+ *
+ * @param[in] attributes the attributes passed to add_breadcrumb()
+ * @param[in] key the name of the attribute
+ * @param[in] default_value the value if the attribute is not set
+ * @return the attribute; non-string values are serialized
+ */
+std::string breadcrumb_attribute(const json& attributes, const char* key, const char* default_value)
+{
+    if (attributes.is_object())
+    {
+        const auto it = attributes.find(key);
+        if (it != attributes.end())
+        {
+            return it->is_string() ? it->get<std::string>() : it->dump();
+        }
+    }
+    return default_value;
+}
+
+/*!
+ * @brief return the name Sentry uses for a breadcrumb level
+ *
+ * @param[in] level the level
+ * @return the name of the level
+ */
+const char* breadcrumb_level_name(const crow::breadcrumb_level level) noexcept
+{
+    switch (level)
+    {
+        case crow::breadcrumb_level::debug:
+            return "debug";
+        case crow::breadcrumb_level::warning:
+            return "warning";
+        case crow::breadcrumb_level::error:
+            return "error";
+        case crow::breadcrumb_level::fatal:
+            return "fatal";
+        case crow::breadcrumb_level::info:
+        default:
+            return "info";
+    }
+}
+
+/*!
+ * @brief return the top layer of the calling thread's scope of a client
+ *
+ * @param[in] client_id the id of the client
+ * @param[in] client_token the token of the client
+ * @return the layer to add context changes to
+ */
+json& thread_layer(const std::uint64_t client_id, const std::shared_ptr<const void>& client_token)
+{
+    auto& thread_scope = get_thread_entry(thread_scopes, client_id, client_token);
+    if (thread_scope.layers.empty())
+    {
+        thread_scope.layers.emplace_back(json::object());
+        thread_scope.base_layer = true;
+    }
+    return thread_scope.layers.back();
+}
+
+/*!
+ * @brief return whether the calling thread collects context changes of a client in its scope
+ *
+ * @param[in] client_id the id of the client
+ * @return whether the thread pushed a scope that is still active
+ */
+bool has_thread_layers(const std::uint64_t client_id)
+{
+    const auto thread_scope = thread_scopes.find(client_id);
+    return thread_scope != thread_scopes.end() and thread_scope->second.layers.size() > (thread_scope->second.base_layer ? 1u : 0u);
+}
+}
+
 crow* crow::m_client_that_installed_termination_handler = nullptr;
 
 crow::crow(const std::string& dsn,
            const json& context,
            const double sample_rate,
-           const bool install_handlers)
-    : m_sample_rate(static_cast<int>(sample_rate * 100.0))
+           const bool install_handlers,
+           std::unique_ptr<crow_transports::transport> transport)
+    : m_id(next_client_id++)
+    , m_token(std::make_shared<char>())
+    , m_sample_rate(static_cast<int>(sample_rate * 100.0))
     , m_enabled(not dsn.empty())
+    , m_rate_limiter(new crow_utilities::rate_limiter())
+    , m_transport(std::move(transport))
+    , m_default_scope(make_default_scope())
+    , m_scope(m_default_scope)
+    , m_retired_breadcrumbs(new crow_utilities::breadcrumb_buffer())
 {
     // process DSN
     if (not dsn.empty())
@@ -71,6 +254,7 @@ crow::crow(const std::string& dsn,
             const auto host = pieces_match.str(5);
             const auto project_id = pieces_match.str(6);
             m_store_url = scheme + "://" + host + "/api/" + project_id + "/store/";
+            m_envelope_url = scheme + "://" + host + "/api/" + project_id + "/envelope/";
         }
         else
         {
@@ -79,7 +263,6 @@ crow::crow(const std::string& dsn,
     }
 
     // manage context
-    clear_context();
     merge_context(context);
 
     // install termination handler
@@ -87,6 +270,75 @@ crow::crow(const std::string& dsn,
     {
         install_handler();
     }
+
+    // start sender thread
+    if (m_enabled)
+    {
+        if (not m_transport)
+        {
+            m_transport.reset(new crow_transports::http_transport());
+        }
+        m_sender = std::thread(&crow::sender_loop, this);
+    }
+}
+
+crow::~crow()
+{
+    close(shutdown_timeout);
+
+    // the entries of other threads are removed once they are found to be expired
+    thread_scopes.erase(m_id);
+    thread_breadcrumbs.erase(m_id);
+}
+
+std::size_t crow::flush(const std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+
+    if (m_pending_events == 0)
+    {
+        return 0;
+    }
+
+    // send partial batches right away
+    ++m_flush_requests;
+    m_queue_filled.notify_one();
+    m_transport->wakeup();
+
+    m_queue_processed.wait_until(lock, deadline, [this] { return m_pending_events == 0; });
+    --m_flush_requests;
+    return m_pending_events;
+}
+
+std::size_t crow::close(const std::chrono::milliseconds timeout)
+{
+    if (not m_sender.joinable())
+    {
+        return 0;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::size_t unsent_events = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+        m_closed = true;
+        m_stop_sender = true;
+        m_queue_filled.notify_one();
+        m_transport->wakeup();
+
+        m_queue_processed.wait_until(lock, deadline, [this] { return m_pending_events == 0; });
+        unsent_events = m_pending_events;
+
+        // do not wait any longer for a hanging connection
+        m_abort_sender = true;
+        m_queue_filled.notify_one();
+        m_transport->wakeup();
+    }
+
+    m_sender.join();
+    return unsent_events;
 }
 
 void crow::install_handler()
@@ -102,13 +354,69 @@ void crow::install_handler()
     }
 }
 
+void crow::set_max_concurrent_requests(const std::size_t requests)
+{
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    m_max_concurrent_requests = (requests == 0) ? 1 : requests;
+}
+
+void crow::set_batching(const std::size_t max_events,
+                        const std::chrono::milliseconds linger)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_max_batch_size = (max_events == 0) ? 1 : max_events;
+        m_batch_linger = linger;
+    }
+
+    m_queue_filled.notify_one();
+}
+
+void crow::set_queue_capacity(const std::size_t max_events, const std::size_t max_bytes)
+{
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    m_max_queue_events = (max_events == 0) ? 1 : max_events;
+    m_max_queue_bytes = max_bytes;
+}
+
+void crow::set_backpressure_policy(const backpressure_policy policy,
+                                   const std::chrono::milliseconds timeout)
+{
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    m_backpressure_policy = policy;
+    m_backpressure_timeout = timeout;
+}
+
+crow::queue_statistics crow::get_queue_statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    return m_queue_statistics;
+}
+
+void crow::set_spool(const std::string& path, const std::size_t max_bytes)
+{
+    std::shared_ptr<crow_utilities::spool> spool = std::make_shared<crow_utilities::spool>(path, max_bytes);
+
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_spool = std::move(spool);
+    }
+
+    // send events left by previous processes
+    m_queue_filled.notify_one();
+}
+
 void crow::capture_message(const std::string& message,
                            const json& attributes)
 {
-    std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload["message"] = message;
-    m_payload["event_id"] = nlohmann::crow_utilities::generate_uuid();
-    m_payload["timestamp"] = nlohmann::crow_utilities::get_iso8601();
+    if (not should_capture())
+    {
+        return;
+    }
+
+    const auto scope = get_scope();
+    json event = make_event(*scope);
+    event["message"] = message;
 
     if (attributes.is_object())
     {
@@ -116,28 +424,28 @@ void crow::capture_message(const std::string& message,
         auto logger = attributes.find("logger");
         if (logger != attributes.end())
         {
-            m_payload["logger"] = *logger;
+            event["logger"] = *logger;
         }
 
         // level
-        m_payload["level"] = attributes.value("level", "error");
+        event["level"] = attributes.value("level", "error");
 
         // context
         auto context = attributes.find("context");
         if (context != attributes.end())
         {
-            merge_context(*context);
+            merge_context(event, *scope, *context);
         }
 
         // extra
         auto extra = attributes.find("extra");
         if (extra != attributes.end())
         {
-            m_payload["extra"] = *extra;
+            merge_context(event, *scope, json::object({{"extra", *extra}}));
         }
     }
 
-    enqueue_post();
+    enqueue_post(scope->dump(event), attributes.is_object() and attributes.value("level", "error") == "fatal");
 }
 
 
@@ -145,138 +453,428 @@ void crow::capture_exception(const std::exception& exception,
                              const json& context,
                              const bool handled)
 {
+    if (not should_capture())
+    {
+        return;
+    }
+
+    // only record the instruction pointers; the sender thread symbolizes them
+    auto backtrace = crow_utilities::capture_backtrace();
+
     std::stringstream thread_id;
     thread_id << std::this_thread::get_id();
-    std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload["exception"].push_back({{"type", crow_utilities::pretty_name(typeid(exception).name())},
+
+    const auto scope = get_scope();
+    json event = make_event(*scope);
+    const std::string backtrace_marker = "crow-backtrace-" + event["event_id"].get<std::string>();
+    event["exception"] = json::array();
+    event["exception"].push_back({{"type", crow_utilities::pretty_name(typeid(exception).name())},
         {"value", exception.what()},
         {"module", crow_utilities::pretty_name(typeid(exception).name(), true)},
         {"mechanism", {{"handled", handled}, {"description", handled ? "handled exception" : "unhandled exception"}}},
-        {"stacktrace", {{"frames", crow_utilities::get_backtrace()}}},
+        {"stacktrace", {{"frames", backtrace_marker}}},
         {"thread_id", thread_id.str()}});
-    m_payload["event_id"] = crow_utilities::generate_uuid();
-    m_payload["timestamp"] = nlohmann::crow_utilities::get_iso8601();
 
     // add given context
-    merge_context(context);
+    merge_context(event, *scope, context);
 
-    enqueue_post();
+    // unhandled exceptions terminate the program
+    enqueue_post(scope->dump(event), not handled, std::move(backtrace), backtrace_marker);
+}
 
-    // we want to support at most m_maximal_jobs running jobs
-    m_jobs.reserve(m_maximal_jobs);
+void crow::set_source_lines(const bool enabled)
+{
+    m_source_lines = enabled;
 }
 
-void crow::add_breadcrumb(const std::string& message,
-                          const json& attributes)
+json crow::make_event(const crow_utilities::scope& scope) const
+{
+    json event = get_thread_values(scope);
+    json breadcrumbs = get_breadcrumbs();
+    if (not breadcrumbs.empty())
+    {
+        event["breadcrumbs"]["values"] = std::move(breadcrumbs);
+    }
+    event["event_id"] = crow_utilities::generate_uuid();
+    event["timestamp"] = crow_utilities::get_iso8601();
+    return event;
+}
+
+json crow::get_thread_values(const crow_utilities::scope& scope) const
 {
-    json breadcrumb =
+    json result = json::object();
+    const auto thread_scope = thread_scopes.find(m_id);
+    if (thread_scope == thread_scopes.end())
     {
-        {"event_id", crow_utilities::generate_uuid()},
-        {"message", message},
-        {"level", "info"},
-        {"type", "default"},
-        {"category", "log"},
-        {"timestamp", crow_utilities::get_timestamp()}
-    };
+        return result;
+    }
 
-    if (attributes.is_object())
+    // only copy the values the thread changed, applying the layers from bottom to top
+    const auto& layers = thread_scope->second.layers;
+    const bool skip_base_layer = thread_scope->second.base_layer and not m_thread_scopes;
+    for (auto layer_it = layers.begin() + (skip_base_layer ? 1 : 0); layer_it != layers.end(); ++layer_it)
     {
-        // type
-        auto type = attributes.find("type");
-        if (type != attributes.end())
+        const auto& layer = *layer_it;
+        for (const auto& el : layer.items())
         {
-            breadcrumb["type"] = *type;
+            auto value = result.find(el.key());
+            if (value == result.end())
+            {
+                value = result.emplace(el.key(), scope.get(el.key())).first;
+            }
+
+            if (value->is_object() and el.value().is_object())
+            {
+                value->update(el.value());
+            }
+            else
+            {
+                *value = el.value();
+            }
         }
+    }
 
-        // level
-        auto level = attributes.find("level");
-        if (level != attributes.end())
+    return result;
+}
+
+json crow::get_breadcrumbs() const
+{
+    json result = json::array();
+    const std::size_t max_breadcrumbs = m_max_breadcrumbs;
+    if (max_breadcrumbs == 0)
+    {
+        return result;
+    }
+
+    const crow_utilities::breadcrumb_buffer* scope_breadcrumbs = nullptr;
+    if (m_thread_scopes)
+    {
+        const auto thread_scope = thread_scopes.find(m_id);
+        if (thread_scope != thread_scopes.end())
         {
-            breadcrumb["level"] = *level;
+            scope_breadcrumbs = &thread_scope->second.breadcrumbs;
         }
+    }
 
-        // category
-        auto category = attributes.find("category");
-        if (category != attributes.end())
+    // copy the buffers, so adding a breadcrumb is only blocked while its buffer is copied, not during the conversion
+    std::vector<crow_utilities::breadcrumb_buffer> buffers;
+    {
+        std::lock_guard<std::mutex> lock(m_breadcrumbs_mutex);
+        retire_breadcrumb_buffers();
+        buffers.reserve(m_breadcrumb_buffers.size() + 1);
+        buffers.push_back(*m_retired_breadcrumbs);
+        for (const auto& buffer : m_breadcrumb_buffers)
         {
-            breadcrumb["category"] = *category;
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            buffers.push_back(buffer->buffer);
         }
+    }
+
+    // find the timestamp of the oldest breadcrumb to send, so only those are converted to JSON
+    std::vector<std::int64_t> timestamps;
+    for (const auto& buffer : buffers)
+    {
+        buffer.append_timestamps(timestamps);
+    }
+    if (scope_breadcrumbs != nullptr)
+    {
+        scope_breadcrumbs->append_timestamps(timestamps);
+    }
+
+    auto since = (std::numeric_limits<std::int64_t>::min)();
+    if (timestamps.size() > max_breadcrumbs)
+    {
+        const auto oldest = timestamps.begin() + static_cast<std::ptrdiff_t>(timestamps.size() - max_breadcrumbs);
+        std::nth_element(timestamps.begin(), oldest, timestamps.end());
+        since = *oldest;
+    }
+
+    for (const auto& buffer : buffers)
+    {
+        buffer.append_to(result, since);
+    }
+    if (scope_breadcrumbs != nullptr)
+    {
+        scope_breadcrumbs->append_to(result, since);
+    }
+
+    // merge the buffers; breadcrumbs with the timestamp of the oldest one may exceed the limit
+    std::stable_sort(result.begin(), result.end(), [](const json & lhs, const json & rhs)
+    {
+        return lhs["timestamp"].get<double>() < rhs["timestamp"].get<double>();
+    });
+    if (result.size() > max_breadcrumbs)
+    {
+        result.erase(result.begin(), result.begin() + static_cast<json::difference_type>(result.size() - max_breadcrumbs));
+    }
+
+    return result;
+}
+
+crow_utilities::shared_breadcrumb_buffer& crow::get_thread_breadcrumbs()
+{
+    auto& buffer = get_thread_entry(thread_breadcrumbs, m_id, m_token).buffer;
+    if (buffer)
+    {
+        return *buffer;
+    }
+
+    buffer = std::make_shared<crow_utilities::shared_breadcrumb_buffer>();
 
-        // data
-        auto data = attributes.find("data");
-        if (data != attributes.end())
+    std::lock_guard<std::mutex> lock(m_breadcrumbs_mutex);
+    retire_breadcrumb_buffers();
+    m_breadcrumb_buffers.push_back(buffer);
+    return *buffer;
+}
+
+void crow::retire_breadcrumb_buffers() const
+{
+    // keep the breadcrumbs of ended threads in a single buffer
+    for (auto it = m_breadcrumb_buffers.begin(); it != m_breadcrumb_buffers.end();)
+    {
+        if (it->use_count() == 1)
+        {
+            // the buffer is only referenced here, so it needs no lock
+            (*it)->buffer.move_to(*m_retired_breadcrumbs);
+            it = m_breadcrumb_buffers.erase(it);
+        }
+        else
         {
-            breadcrumb["data"] = *data;
+            ++it;
         }
     }
+}
+
+void crow::set_thread_scopes(const bool enabled)
+{
+    m_thread_scopes = enabled;
+}
+
+crow::scope_guard crow::push_scope()
+{
+    // scopes are always collected per thread, so concurrent scopes do not see or discard each other's changes
+    auto& layers = get_thread_entry(thread_scopes, m_id, m_token).layers;
+    layers.emplace_back(json::object());
+    return scope_guard(this, layers.size() - 1);
+}
+
+void crow::pop_scope(const std::size_t depth)
+{
+    // the layers may already be gone after clear_context()
+    const auto layers = thread_scopes.find(m_id);
+    if (layers != thread_scopes.end() and layers->second.layers.size() > depth)
+    {
+        layers->second.layers.resize(depth);
+    }
+}
+
+crow::scope_guard::scope_guard(crow* client, const std::size_t depth) noexcept
+    : m_client(client)
+    , m_depth(depth)
+{}
+
+crow::scope_guard::scope_guard(scope_guard&& other) noexcept
+    : m_client(other.m_client)
+    , m_depth(other.m_depth)
+{
+    other.m_client = nullptr;
+}
+
+crow::scope_guard::~scope_guard()
+{
+    if (m_client != nullptr)
+    {
+        m_client->pop_scope(m_depth);
+    }
+}
 
+std::shared_ptr<const crow_utilities::scope> crow::get_scope() const
+{
     std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload["breadcrumbs"]["values"].push_back(std::move(breadcrumb));
+    return m_scope;
+}
+
+void crow::add_breadcrumb(const std::string& message,
+                          const json& attributes)
+{
+    const auto level = breadcrumb_attribute(attributes, "level", "info");
+    const auto type = breadcrumb_attribute(attributes, "type", "default");
+    const auto category = breadcrumb_attribute(attributes, "category", "log");
+
+    // data is stored serialized
+    std::string data;
+    if (attributes.is_object())
+    {
+        const auto it = attributes.find("data");
+        if (it != attributes.end())
+        {
+            data = it->dump();
+        }
+    }
+
+    push_breadcrumb(message, level, type, category, data);
+}
+
+void crow::add_breadcrumb(const char* message,
+                          const breadcrumb_level level,
+                          const char* category)
+{
+    push_breadcrumb(message, breadcrumb_level_name(level), "default", category, "");
+}
+
+void crow::add_breadcrumb(const std::string& message,
+                          const breadcrumb_level level,
+                          const char* category)
+{
+    push_breadcrumb(message, breadcrumb_level_name(level), "default", category, "");
+}
+
+void crow::push_breadcrumb(const crow_utilities::string_ref& message,
+                           const crow_utilities::string_ref& level,
+                           const crow_utilities::string_ref& type,
+                           const crow_utilities::string_ref& category,
+                           const crow_utilities::string_ref& data)
+{
+    // microseconds, so breadcrumbs of different threads can be ordered
+    const auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (m_thread_scopes)
+    {
+        auto& breadcrumbs = get_thread_entry(thread_scopes, m_id, m_token).breadcrumbs;
+        breadcrumbs.set_capacity(m_max_breadcrumbs, m_max_breadcrumb_bytes);
+        breadcrumbs.push(timestamp, message, level, type, category, data);
+        return;
+    }
+
+    // only the calling thread writes to its buffer
+    auto& buffer = get_thread_breadcrumbs();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.buffer.set_capacity(m_max_breadcrumbs, m_max_breadcrumb_bytes);
+    buffer.buffer.push(timestamp, message, level, type, category, data);
+}
+
+void crow::set_breadcrumb_capacity(const std::size_t max_breadcrumbs, const std::size_t max_bytes)
+{
+    std::lock_guard<std::mutex> lock(m_breadcrumbs_mutex);
+    m_max_breadcrumbs = max_breadcrumbs;
+    m_max_breadcrumb_bytes = max_bytes;
+    m_retired_breadcrumbs->set_capacity(max_breadcrumbs, max_bytes);
+    for (const auto& buffer : m_breadcrumb_buffers)
+    {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->buffer.set_capacity(max_breadcrumbs, max_bytes);
+    }
 }
 
 std::string crow::get_last_event_id() const
 {
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
     if (not m_posts)
     {
         return "";
     }
 
-    std::lock_guard<std::mutex> lock(m_jobs_mutex);
-    if (not m_jobs.empty() and m_jobs.back().valid())
+    // wait until the sender thread processed all queued events
+    m_queue_processed.wait(lock, [this] { return m_pending_events == 0; });
+
+    assert(not m_last_event_id.empty());
+    return m_last_event_id;
+}
+
+std::string crow::get_last_event_id(const std::chrono::milliseconds timeout) const
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+    if (not m_posts)
     {
-        m_last_event_id = m_jobs.back().get();
-        m_jobs.clear();
+        return "";
     }
 
-    assert(not m_last_event_id.empty());
+    // wait until the sender thread processed all queued events or the time is up
+    m_queue_processed.wait_until(lock, deadline, [this] { return m_pending_events == 0; });
     return m_last_event_id;
 }
 
-const json& crow::get_context() const
+json crow::get_context() const
 {
-    return m_payload;
+    const auto scope = get_scope();
+    json result = scope->to_json();
+    json thread_values = get_thread_values(*scope);
+    for (auto& el : thread_values.items())
+    {
+        result[el.key()] = std::move(el.value());
+    }
+    json breadcrumbs = get_breadcrumbs();
+    if (not breadcrumbs.empty())
+    {
+        result["breadcrumbs"]["values"] = std::move(breadcrumbs);
+    }
+    return result;
 }
 
 void crow::set_release( const std::string & release )
 {
     std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload["release"] = release;
+    m_scope = std::make_shared<const crow_utilities::scope>(m_scope->with("release", release));
 }
 
 void crow::add_user_context(const json& data)
 {
-    std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload["user"].update(data);
+    merge_context(json::object({{"user", data}}));
 }
 
 void crow::add_tags_context(const json& data)
 {
-    std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload["tags"].update(data);
+    merge_context(json::object({{"tags", data}}));
 }
 
 void crow::add_request_context(const json& data)
 {
-    std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload["request"].update(data);
+    merge_context(json::object({{"request", data}}));
 }
 
 void crow::add_extra_context(const json& data)
 {
-    std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload["extra"].update(data);
+    merge_context(json::object({{"extra", data}}));
 }
 
 void crow::merge_context(const json& context)
+{
+    if (m_thread_scopes or has_thread_layers(m_id))
+    {
+        // the thread scope only contains the changes, so it inherits later changes of the global scope
+        static const crow_utilities::scope empty_scope;
+        merge_context(thread_layer(m_id, m_token), empty_scope, context);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_payload_mutex);
+
+    // only copy the values that change
+    json values = json::object();
+    merge_context(values, *m_scope, context);
+
+    auto scope = *m_scope;
+    for (auto& value : values.items())
+    {
+        scope = scope.with(value.key(), std::move(value.value()));
+    }
+    m_scope = std::make_shared<const crow_utilities::scope>(std::move(scope));
+}
+
+void crow::merge_context(json& values, const crow_utilities::scope& scope, const json& context)
 {
     if (context.is_object())
     {
-        std::lock_guard<std::mutex> lock(m_payload_mutex);
         for (const auto& el : context.items())
         {
             if (el.key() == "user" or el.key() == "request" or el.key() == "extra" or el.key() == "tags")
             {
-                m_payload[el.key()].update(el.value());
+                if (values.find(el.key()) == values.end())
+                {
+                    values[el.key()] = scope.get(el.key());
+                }
+                values[el.key()].update(el.value());
             }
             else
             {
@@ -288,46 +886,77 @@ void crow::merge_context(const json& context)
 
 void crow::clear_context()
 {
+    if (m_thread_scopes)
+    {
+        thread_scopes.erase(m_id);
+        return;
+    }
+
+    // keep the layers of pushed scopes, so their guards still pop them
+    const auto thread_scope = thread_scopes.find(m_id);
+    if (thread_scope != thread_scopes.end())
+    {
+        for (auto& layer : thread_scope->second.layers)
+        {
+            layer = json::object();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_breadcrumbs_mutex);
+        m_retired_breadcrumbs->clear();
+        for (const auto& buffer : m_breadcrumb_buffers)
+        {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            buffer->buffer.clear();
+        }
+    }
+
     std::lock_guard<std::mutex> lock(m_payload_mutex);
-    m_payload.clear();
-    m_payload["platform"] = "c";
-    m_payload["sdk"]["name"] = "crow";
-    m_payload["sdk"]["version"] = NLOHMANN_CROW_VERSION;
+    m_scope = m_default_scope;
+}
+
+std::shared_ptr<const crow_utilities::scope> crow::make_default_scope()
+{
+    json payload;
+    payload["platform"] = "c";
+    payload["sdk"]["name"] = "crow";
+    payload["sdk"]["version"] = NLOHMANN_CROW_VERSION;
 
     // add context: app
-    m_payload["contexts"]["app"]["build_type"] = NLOHMANN_CROW_CMAKE_BUILD_TYPE;
-    m_payload["contexts"]["app"]["pointer_size"] = NLOHMANN_CROW_BITS;
+    payload["contexts"]["app"]["build_type"] = NLOHMANN_CROW_CMAKE_BUILD_TYPE;
+    payload["contexts"]["app"]["pointer_size"] = NLOHMANN_CROW_BITS;
 
     // add context: device
-    m_payload["contexts"]["device"]["arch"] = NLOHMANN_CROW_CMAKE_SYSTEM_PROCESSOR;
-    m_payload["contexts"]["device"]["name"] = NLOHMANN_CROW_HOSTNAME;
-    m_payload["contexts"]["device"]["model"] = NLOHMANN_CROW_SYSCTL_HW_MODEL;
-    m_payload["contexts"]["device"]["memory_size"] = NLOHMANN_CROW_TOTAL_PHYSICAL_MEMORY;
+    payload["contexts"]["device"]["arch"] = NLOHMANN_CROW_CMAKE_SYSTEM_PROCESSOR;
+    payload["contexts"]["device"]["name"] = NLOHMANN_CROW_HOSTNAME;
+    payload["contexts"]["device"]["model"] = NLOHMANN_CROW_SYSCTL_HW_MODEL;
+    payload["contexts"]["device"]["memory_size"] = NLOHMANN_CROW_TOTAL_PHYSICAL_MEMORY;
 
     // add context: os
-    m_payload["contexts"]["os"]["name"] = NLOHMANN_CROW_CMAKE_SYSTEM_NAME;
-    m_payload["contexts"]["os"]["version"] = NLOHMANN_CROW_OS_RELEASE;
+    payload["contexts"]["os"]["name"] = NLOHMANN_CROW_CMAKE_SYSTEM_NAME;
+    payload["contexts"]["os"]["version"] = NLOHMANN_CROW_OS_RELEASE;
     if (not std::string(NLOHMANN_CROW_OS_VERSION).empty())
     {
-        m_payload["contexts"]["os"]["build"] = NLOHMANN_CROW_OS_VERSION;
+        payload["contexts"]["os"]["build"] = NLOHMANN_CROW_OS_VERSION;
     }
     else
     {
-        m_payload["contexts"]["os"]["build"] = NLOHMANN_CROW_CMAKE_SYSTEM_VERSION;
+        payload["contexts"]["os"]["build"] = NLOHMANN_CROW_CMAKE_SYSTEM_VERSION;
     }
     if (not std::string(NLOHMANN_CROW_UNAME).empty())
     {
-        m_payload["contexts"]["os"]["kernel_version"] = NLOHMANN_CROW_UNAME;
+        payload["contexts"]["os"]["kernel_version"] = NLOHMANN_CROW_UNAME;
     }
     else if (not std::string(NLOHMANN_CROW_SYSTEMINFO).empty())
     {
-        m_payload["contexts"]["os"]["kernel_version"] = NLOHMANN_CROW_SYSTEMINFO;
+        payload["contexts"]["os"]["kernel_version"] = NLOHMANN_CROW_SYSTEMINFO;
     }
 
     // add context: runtime
-    m_payload["contexts"]["runtime"]["name"] = NLOHMANN_CROW_CMAKE_CXX_COMPILER_ID;
-    m_payload["contexts"]["runtime"]["version"] = NLOHMANN_CROW_CMAKE_CXX_COMPILER_VERSION;
-    m_payload["contexts"]["runtime"]["detail"] = NLOHMANN_CROW_CXX;
+    payload["contexts"]["runtime"]["name"] = NLOHMANN_CROW_CMAKE_CXX_COMPILER_ID;
+    payload["contexts"]["runtime"]["version"] = NLOHMANN_CROW_CMAKE_CXX_COMPILER_VERSION;
+    payload["contexts"]["runtime"]["detail"] = NLOHMANN_CROW_CXX;
 
     // add context: user
     const char* user = getenv("USER");
@@ -337,63 +966,440 @@ void crow::clear_context()
     }
     if (user)
     {
-        m_payload["user"]["id"] = std::string(user) + "@" + NLOHMANN_CROW_HOSTNAME;
-        m_payload["user"]["username"] = user;
+        payload["user"]["id"] = std::string(user) + "@" + NLOHMANN_CROW_HOSTNAME;
+        payload["user"]["username"] = user;
     }
+
+    crow_utilities::scope scope;
+    for (auto& value : payload.items())
+    {
+        scope = scope.with(value.key(), std::move(value.value()));
+    }
+    return std::make_shared<const crow_utilities::scope>(std::move(scope));
 }
 
-std::string crow::post(json payload) const
+void crow::post(const std::vector<std::string>& events, const bool as_envelope, post_handler on_finished)
 {
-    curl_wrapper curl;
+    assert(m_transport);
+    crow_transports::request request;
 
     // add security header
-    std::string security_header = "X-Sentry-Auth: Sentry sentry_version=5,sentry_client=crow/";
-    security_header += std::string(NLOHMANN_CROW_VERSION) + ",sentry_timestamp=";
-    security_header += std::to_string(crow_utilities::get_timestamp());
-    security_header += ",sentry_key=" + m_public_key;
-    security_header += ",sentry_secret=" + m_secret_key;
-    curl.set_header(security_header.c_str());
+    request.auth = "Sentry sentry_version=5,sentry_client=crow/";
+    request.auth += std::string(NLOHMANN_CROW_VERSION) + ",sentry_timestamp=";
+    request.auth += std::to_string(crow_utilities::get_timestamp());
+    request.auth += ",sentry_key=" + m_public_key;
+    request.auth += ",sentry_secret=" + m_secret_key;
+
+    if (as_envelope)
+    {
+        request.url = m_envelope_url;
+        request.content_type = "application/x-sentry-envelope";
+        request.body = crow_utilities::make_envelope(events);
+    }
+    else
+    {
+        assert(events.size() == 1);
+        request.url = m_store_url;
+        request.content_type = "application/json";
+        request.body = events.front();
+    }
+
+    m_transport->send(std::move(request), [this, on_finished](crow_transports::response response)
+    {
+        if (response.status_code == 0)
+        {
+            on_finished(0, "");
+            return;
+        }
+
+        m_rate_limiter->update(response.status_code,
+                               response.header("retry-after"),
+                               response.header("x-sentry-rate-limits"));
+
+        std::string event_id;
+        if (response.status_code == 200)
+        {
+            try
+            {
+                event_id = json::parse(response.body).at("id").get<std::string>();
+            }
+            catch (const std::exception&)
+            {
+                // Sentry did not return an event id
+            }
+        }
+        on_finished(response.status_code, std::move(event_id));
+    });
+}
+
+void crow::post_finished(const std::size_t sequence, std::string event_id, const std::size_t event_count)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+
+        // with concurrent requests, responses may arrive out of order
+        if (not event_id.empty() and sequence > m_last_event_sequence)
+        {
+            m_last_event_id = std::move(event_id);
+            m_last_event_sequence = sequence;
+        }
+        m_pending_events -= event_count;
+    }
 
-    return curl.post(m_store_url, payload, true).data;
+    m_queue_processed.notify_all();
 }
 
-void crow::enqueue_post()
+bool crow::should_capture() const
 {
     if (not m_enabled)
     {
-        return;
+        return false;
+    }
+
+    // do not spend any work on events Sentry would reject
+    if (m_rate_limiter->is_limited(crow_utilities::rate_limiter::category::error))
+    {
+        return false;
     }
 
     // https://docs.sentry.io/clientdev/features/#event-sampling
-    const auto rand = crow_utilities::get_random_number(0, 99);
-    if (rand >= m_sample_rate)
+    return m_sample_rate >= 100 or crow_utilities::get_random_number(0, 99) < m_sample_rate;
+}
+
+void crow::enqueue_post(std::string payload,
+                        const bool fatal,
+                        std::vector<void*> backtrace,
+                        std::string backtrace_marker)
+{
+    assert(m_enabled);
+    queued_event queued = {std::move(payload), fatal, std::chrono::steady_clock::now(), std::move(backtrace), std::move(backtrace_marker)};
+    bool sender_performing = false;
+
     {
-        return;
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+
+        if (m_closed or not make_room(lock, queued))
+        {
+            ++m_queue_statistics.dropped;
+            return;
+        }
+
+        // remember we made a post and now can rely on a last id
+        m_posts = true;
+
+        m_queued_bytes += queued.payload.size();
+        m_queue.push_back(std::move(queued));
+        ++m_pending_events;
+        ++m_queue_statistics.accepted;
+
+        // otherwise the sender thread waits for m_queue_filled or checks the queue anyway
+        sender_performing = m_sender_performing;
+    }
+
+    m_queue_filled.notify_one();
+    if (sender_performing)
+    {
+        // a wakeup costs a system call with the HTTP transport
+        m_transport->wakeup();
     }
+}
+
+std::string crow::finish_payload(queued_event& event) const
+{
+    if (not event.backtrace_marker.empty())
+    {
+        const auto marker = json(event.backtrace_marker).dump();
+        const auto position = event.payload.find(marker);
+        if (position != std::string::npos)
+        {
+            event.payload.replace(position, marker.size(), crow_utilities::symbolize_backtrace(event.backtrace, m_source_lines).dump());
+        }
+    }
+    return std::move(event.payload);
+}
+
+bool crow::queue_full(const std::size_t bytes) const
+{
+    return m_queue.size() >= m_max_queue_events
+           or (m_max_queue_bytes != 0 and m_queued_bytes + bytes > m_max_queue_bytes);
+}
+
+bool crow::make_room(std::unique_lock<std::mutex>& lock, const queued_event& event)
+{
+    const auto bytes = event.payload.size();
+
+    // an event larger than the whole queue can never be accepted
+    if (m_max_queue_bytes != 0 and bytes > m_max_queue_bytes)
+    {
+        return false;
+    }
+
+    switch (m_backpressure_policy)
+    {
+        case backpressure_policy::drop_newest:
+            break;
+
+        case backpressure_policy::drop_oldest:
+            while (queue_full(bytes) and not m_queue.empty())
+            {
+                drop_queued_event(m_queue.begin());
+            }
+            break;
+
+        case backpressure_policy::block:
+            // the capturing thread waits until the sender thread took events from the queue
+            m_queue_space.wait_for(lock, m_backpressure_timeout, [this, bytes] { return not queue_full(bytes); });
+            break;
+
+        case backpressure_policy::preserve_fatal:
+            if (event.fatal)
+            {
+                // drop the oldest non-fatal events; fatal events are never replaced
+                auto it = m_queue.begin();
+                while (queue_full(bytes) and it != m_queue.end())
+                {
+                    it = it->fatal ? std::next(it) : drop_queued_event(it);
+                }
+            }
+            break;
+    }
+
+    return not queue_full(bytes);
+}
+
+std::deque<crow::queued_event>::iterator crow::drop_queued_event(std::deque<queued_event>::iterator it)
+{
+    m_queued_bytes -= it->payload.size();
+    --m_pending_events;
+    ++m_queue_statistics.dropped;
+    m_queue_processed.notify_all();
+    return m_queue.erase(it);
+}
+
+bool crow::batch_ready() const
+{
+    if (m_queue.empty())
+    {
+        return false;
+    }
+
+    // send a partial batch if it waited long enough, the client stops, or events are flushed
+    return m_queue.size() >= m_max_batch_size or m_stop_sender or m_flush_requests != 0
+           or std::chrono::steady_clock::now() >= m_queue.front().enqueued + m_batch_linger;
+}
+
+void crow::sender_loop()
+{
+    // the number of the last event taken from the queue
+    std::size_t sequence = 0;
+
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+
+    while (true)
+    {
+        if (m_abort_sender)
+        {
+            abort_events(lock, sequence);
+            return;
+        }
+
+        // start as many uploads as allowed
+        while (m_transport->in_flight() < m_max_concurrent_requests and batch_ready())
+        {
+            const bool as_envelope = m_max_batch_size > 1;
+            std::vector<queued_event> batch;
+            while (not m_queue.empty() and batch.size() < m_max_batch_size)
+            {
+                m_queued_bytes -= m_queue.front().payload.size();
+                batch.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+            m_queue_space.notify_all();
+            sequence += batch.size();
+            const auto batch_sequence = sequence;
+
+            // drop events that became rate-limited while waiting in the queue
+            if (m_rate_limiter->is_limited(crow_utilities::rate_limiter::category::error))
+            {
+                lock.unlock();
+                post_finished(batch_sequence, "", batch.size());
+                lock.lock();
+                continue;
+            }
+
+            lock.unlock();
+
+            // symbolize stack traces without blocking the capturing threads
+            auto events = std::make_shared<std::vector<std::string>>();
+            for (auto& event : batch)
+            {
+                events->push_back(finish_payload(event));
+            }
+
+            try
+            {
+                post(*events, as_envelope, [this, events, batch_sequence](int status_code, std::string event_id)
+                {
+                    if (is_retryable(status_code))
+                    {
+                        spool_events(*events);
+                    }
+                    post_finished(batch_sequence, std::move(event_id), events->size());
+                });
+            }
+            catch (const std::exception&)
+            {
+                // the events are lost, but the client stays usable
+                post_finished(batch_sequence, "", events->size());
+            }
+            lock.lock();
+        }
+
+        if (m_transport->in_flight() != 0)
+        {
+            // drive the uploads without blocking the capturing threads; the
+            // completion callbacks call post_finished()
+            m_sender_performing = true;
+            lock.unlock();
+            m_transport->perform(std::chrono::milliseconds(100));
+            lock.lock();
+            m_sender_performing = false;
+        }
+        else if (m_queue.empty())
+        {
+            if (m_stop_sender)
+            {
+                // all events have been sent; spooled events are sent by the next process
+                return;
+            }
+
+            const auto queue_filled = [this] { return m_stop_sender or not m_queue.empty(); };
+            if (m_spool and not m_spool->empty())
+            {
+                // Sentry would reject spooled events while a rate limit is active
+                m_spool_retry = (std::max)(m_spool_retry, m_rate_limiter->limited_until(crow_utilities::rate_limiter::category::error));
+
+                if (std::chrono::steady_clock::now() >= m_spool_retry)
+                {
+                    replay_spooled_event(lock);
+                }
+                else
+                {
+                    m_queue_filled.wait_until(lock, m_spool_retry, queue_filled);
+                }
+            }
+            else
+            {
+                // set_spool() may provide events left by a previous process
+                const auto spool_filled = [this] { return m_spool and not m_spool->empty(); };
+                m_queue_filled.wait(lock, [&] { return queue_filled() or spool_filled(); });
+            }
+        }
+        else
+        {
+            // wait until the batch is full or its linger time is over; a
+            // notification may also change the batch settings, so the loop
+            // checks again after every wakeup
+            m_queue_filled.wait_until(lock, m_queue.front().enqueued + m_batch_linger);
+        }
+    }
+}
+
+void crow::abort_events(std::unique_lock<std::mutex>& lock, std::size_t sequence)
+{
+    std::deque<queued_event> queue;
+    queue.swap(m_queue);
+    m_queued_bytes = 0;
+    lock.unlock();
+
+    std::vector<std::string> events;
+    for (auto& event : queue)
+    {
+        events.push_back(finish_payload(event));
+    }
+
+    // the callbacks of the running requests spool their events
+    m_transport->abort();
+
+    if (not events.empty())
+    {
+        spool_events(events);
+        post_finished(sequence + events.size(), "", events.size());
+    }
+
+    lock.lock();
+}
 
-    // we want to change the job list
-    std::lock_guard<std::mutex> lock_jobs(m_jobs_mutex);
+bool crow::is_retryable(const int status_code)
+{
+    // network errors and server errors; other errors would occur again
+    return status_code == 0 or status_code >= 500;
+}
 
-    // remember we made a post and now can rely on a last id
-    m_posts = true;
+void crow::spool_events(const std::vector<std::string>& events)
+{
+    m_spool_retry = std::chrono::steady_clock::now() + spool_retry_delay;
 
-    // enforce maximal number of running jobs
-    if (m_jobs.size() == m_maximal_jobs)
+    std::shared_ptr<crow_utilities::spool> spool;
     {
-        // clearing the vector of futures means waiting for their result; we do
-        // not need to save an event id, because we will add another post job
-        // below
-        m_jobs.clear();
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        spool = m_spool;
+    }
+
+    if (spool)
+    {
+        for (const auto& event : events)
+        {
+            spool->push(event);
+        }
     }
+}
+
+void crow::replay_spooled_event(std::unique_lock<std::mutex>& lock)
+{
+    const auto spool = m_spool;
+    const bool as_envelope = m_max_batch_size > 1;
+    lock.unlock();
 
-    // add the new job
-    m_jobs.emplace_back(std::async(std::launch::async, [this]()
+    std::string data;
+    if (spool->front(data) and not json::accept(data))
     {
-        return json::parse(post(m_payload)).at("id").get<std::string>();
-    }));
+        // the record is corrupt and can never be sent
+        spool->pop();
+    }
+    else if (not data.empty())
+    {
+        try
+        {
+            post({data}, as_envelope, [this, spool, data](int status_code, std::string)
+            {
+                std::string current;
+                if (is_retryable(status_code))
+                {
+                    // Sentry is still unreachable; keep the event
+                    m_spool_retry = std::chrono::steady_clock::now() + spool_retry_delay;
+                }
+                else if (status_code == 429)
+                {
+                    // keep the event and retry once the rate limit is over
+                    m_spool_retry = (std::max)(std::chrono::steady_clock::now() + spool_retry_delay,
+                                               m_rate_limiter->limited_until(crow_utilities::rate_limiter::category::error));
+                }
+                else if (spool->front(current) and current == data)
+                {
+                    // the event may have been discarded meanwhile to make room for new events
+                    spool->pop();
+                }
+            });
+        }
+        catch (const std::exception&)
+        {
+            // the request could not be started; keep the event
+            m_spool_retry = std::chrono::steady_clock::now() + spool_retry_delay;
+        }
+    }
 
-    assert(not m_jobs.empty());
-    assert(m_jobs.back().valid());
+    lock.lock();
 }
 
 void crow::new_termination_handler()
@@ -412,6 +1418,9 @@ void crow::new_termination_handler()
         {
             m_client_that_installed_termination_handler->capture_exception(e, nullptr, false);
         }
+
+        // the program is about to terminate
+        m_client_that_installed_termination_handler->flush(shutdown_timeout);
     }
 
     m_client_that_installed_termination_handler->existing_termination_handler();
@@ -0,0 +1,267 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file crow_breadcrumbs.cpp
+ * @brief implementation of Crow's breadcrumb buffer
+ */
+
+#include <algorithm> // copy, max, min
+#include <cassert> // assert
+#include <src/crow_breadcrumbs.hpp>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+breadcrumb_buffer::breadcrumb_buffer(const std::size_t max_breadcrumbs, const std::size_t max_bytes)
+    : m_records(max_breadcrumbs)
+    , m_max_bytes(max_bytes)
+    , m_text(max_bytes)
+{}
+
+void breadcrumb_buffer::set_capacity(const std::size_t max_breadcrumbs, const std::size_t max_bytes)
+{
+    if (max_breadcrumbs == m_records.size() and max_bytes == m_max_bytes)
+    {
+        return;
+    }
+
+    // copy the newest breadcrumbs that fit into a new buffer
+    breadcrumb_buffer result(max_breadcrumbs, max_bytes);
+    move_to(result);
+    *this = std::move(result);
+}
+
+void breadcrumb_buffer::move_to(breadcrumb_buffer& target)
+{
+    for (std::size_t i = 0; i < m_size; ++i)
+    {
+        const auto& r = at(i);
+        target.push(r.timestamp, message(r), m_strings[r.level].value, m_strings[r.type].value, m_strings[r.category].value, data(r));
+    }
+    clear();
+}
+
+void breadcrumb_buffer::push(const std::int64_t timestamp,
+                             const string_ref message,
+                             const string_ref level,
+                             const string_ref type,
+                             const string_ref category,
+                             const string_ref data)
+{
+    const std::size_t text_size = message.size + data.size;
+    if (m_records.empty() or (m_max_bytes != 0 and text_size > m_max_bytes))
+    {
+        return;
+    }
+
+    // evict the oldest breadcrumbs until the new one fits
+    while (m_size == m_records.size() or (m_max_bytes != 0 and m_text_size + text_size > m_max_bytes))
+    {
+        pop();
+    }
+    reserve_text(text_size);
+
+    auto& r = m_records[(m_first + m_size) % m_records.size()];
+    r.timestamp = timestamp;
+    r.text = write_text(message);
+    write_text(data);
+    r.message_size = message.size;
+    r.data_size = data.size;
+    r.level = intern(level);
+    r.type = intern(type);
+    r.category = intern(category);
+    ++m_size;
+}
+
+void breadcrumb_buffer::pop()
+{
+    assert(m_size != 0);
+    const auto& r = m_records[m_first];
+    --m_strings[r.level].references;
+    --m_strings[r.type].references;
+    --m_strings[r.category].references;
+
+    const std::size_t text_size = r.message_size + r.data_size;
+    m_text_first = m_text_size == text_size ? 0 : (m_text_first + text_size) % m_text.size();
+    m_text_size -= text_size;
+
+    m_first = (m_first + 1) % m_records.size();
+    --m_size;
+}
+
+void breadcrumb_buffer::clear()
+{
+    while (m_size != 0)
+    {
+        pop();
+    }
+    m_first = 0;
+}
+
+std::size_t breadcrumb_buffer::size() const
+{
+    return m_size;
+}
+
+std::size_t breadcrumb_buffer::bytes() const
+{
+    return m_text_size;
+}
+
+void breadcrumb_buffer::append_to(json& values, const std::int64_t since) const
+{
+    for (std::size_t i = 0; i < m_size; ++i)
+    {
+        const auto& r = at(i);
+        if (r.timestamp < since)
+        {
+            continue;
+        }
+
+        json breadcrumb =
+        {
+            {"timestamp", static_cast<double>(r.timestamp) / 1e6},
+            {"message", message(r)},
+            {"level", m_strings[r.level].value},
+            {"type", m_strings[r.type].value},
+            {"category", m_strings[r.category].value}
+        };
+        if (r.data_size != 0)
+        {
+            breadcrumb["data"] = json::parse(data(r));
+        }
+        values.push_back(std::move(breadcrumb));
+    }
+}
+
+void breadcrumb_buffer::append_timestamps(std::vector<std::int64_t>& timestamps) const
+{
+    for (std::size_t i = 0; i < m_size; ++i)
+    {
+        timestamps.push_back(at(i).timestamp);
+    }
+}
+
+const breadcrumb_buffer::record& breadcrumb_buffer::at(const std::size_t index) const
+{
+    return m_records[(m_first + index) % m_records.size()];
+}
+
+std::string breadcrumb_buffer::message(const record& r) const
+{
+    return read_text(r.text, r.message_size);
+}
+
+std::string breadcrumb_buffer::data(const record& r) const
+{
+    return r.data_size == 0 ? "" : read_text((r.text + r.message_size) % m_text.size(), r.data_size);
+}
+
+std::uint32_t breadcrumb_buffer::intern(const string_ref value)
+{
+    // there are few distinct strings, and each live record references at most three of them
+    std::size_t unused = m_strings.size();
+    for (std::size_t i = 0; i < m_strings.size(); ++i)
+    {
+        if (m_strings[i].value.compare(0, std::string::npos, value.data, value.size) == 0)
+        {
+            ++m_strings[i].references;
+            return static_cast<std::uint32_t>(i);
+        }
+        if (m_strings[i].references == 0 and unused == m_strings.size())
+        {
+            unused = i;
+        }
+    }
+
+    if (unused == m_strings.size())
+    {
+        m_strings.emplace_back();
+    }
+    m_strings[unused].value.assign(value.data, value.size);
+    m_strings[unused].references = 1;
+    return static_cast<std::uint32_t>(unused);
+}
+
+void breadcrumb_buffer::reserve_text(const std::size_t size)
+{
+    if (m_text_size + size <= m_text.size())
+    {
+        return;
+    }
+
+    // without byte limit, grow the ring and move the text to its beginning
+    assert(m_max_bytes == 0);
+    std::vector<char> text(std::max(std::max<std::size_t>(2 * m_text.size(), 1024), m_text_size + size));
+    if (not m_text.empty())
+    {
+        for (std::size_t i = 0; i < m_size; ++i)
+        {
+            auto& r = m_records[(m_first + i) % m_records.size()];
+            r.text = (r.text + m_text.size() - m_text_first) % m_text.size();
+        }
+        const std::string old_text = read_text(m_text_first, m_text_size);
+        std::copy(old_text.begin(), old_text.end(), text.begin());
+    }
+    m_text = std::move(text);
+    m_text_first = 0;
+}
+
+std::size_t breadcrumb_buffer::write_text(const string_ref text)
+{
+    assert(m_text_size + text.size <= m_text.size());
+    const std::size_t position = m_text.empty() ? 0 : (m_text_first + m_text_size) % m_text.size();
+
+    // the text may wrap around the end of the ring
+    const std::size_t head = std::min(text.size, m_text.size() - position);
+    std::copy(text.data, text.data + head, m_text.begin() + static_cast<std::ptrdiff_t>(position));
+    std::copy(text.data + head, text.data + text.size, m_text.begin());
+
+    m_text_size += text.size;
+    return position;
+}
+
+std::string breadcrumb_buffer::read_text(const std::size_t position, const std::size_t size) const
+{
+    if (size == 0)
+    {
+        return "";
+    }
+
+    const std::size_t head = std::min(size, m_text.size() - position);
+    std::string result(m_text.data() + position, head);
+    result.append(m_text.data(), size - head);
+    return result;
+}
+
+}
+}
@@ -0,0 +1,241 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef NLOHMANN_CROW_BREADCRUMBS_HPP
+#define NLOHMANN_CROW_BREADCRUMBS_HPP
+
+/*!
+ * @file crow_breadcrumbs.hpp
+ * @brief bounded storage for breadcrumbs
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <thirdparty/json/json.hpp>
+
+using json = nlohmann::json;
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+/*!
+ * @brief a non-owning reference to characters, to pass strings without copying them
+ */
+struct string_ref
+{
+    string_ref(const char* str) noexcept
+        : data(str), size(std::strlen(str))
+    {}
+
+    string_ref(const std::string& str) noexcept
+        : data(str.data()), size(str.size())
+    {}
+
+    /// the characters (not null-terminated)
+    const char* data;
+    /// the number of characters
+    std::size_t size;
+};
+
+/*!
+ * @brief a ring buffer of the most recent breadcrumbs
+ *
+ * Breadcrumbs are stored as fixed-size records: level, type, and category
+ * are interned, and the message and the serialized data are copied into a
+ * ring of characters. Breadcrumbs are only converted to JSON when an event
+ * includes them.
+ *
+ * The buffer keeps at most a given number of breadcrumbs whose text (message
+ * and serialized data) does not exceed a given number of bytes. Adding a
+ * breadcrumb to a full buffer evicts the oldest breadcrumbs.
+ */
+class breadcrumb_buffer
+{
+  public:
+    /*!
+     * @param[in] max_breadcrumbs the maximal number of breadcrumbs
+     * @param[in] max_bytes the maximal size of the text of all breadcrumbs (0: unlimited)
+     */
+    explicit breadcrumb_buffer(std::size_t max_breadcrumbs = 100, std::size_t max_bytes = 0);
+
+    /*!
+     * @brief change the limits, evicting the oldest breadcrumbs if needed
+     * @param[in] max_breadcrumbs the maximal number of breadcrumbs
+     * @param[in] max_bytes the maximal size of the text of all breadcrumbs (0: unlimited)
+     */
+    void set_capacity(std::size_t max_breadcrumbs, std::size_t max_bytes);
+
+    /*!
+     * @brief add a breadcrumb
+     * @param[in] timestamp the time of the breadcrumb (microseconds since epoch)
+     * @param[in] message the message
+     * @param[in] level the level, e.g. "info"
+     * @param[in] type the type, e.g. "default"
+     * @param[in] category the category, e.g. "log"
+     * @param[in] data the serialized data object, or an empty string
+     * @note A breadcrumb whose text is larger than the byte limit is dropped.
+     * @note Once the buffer is full, adding a breadcrumb only allocates
+     *       memory if its level, type, or category is new or its text does
+     *       not fit in the memory of the evicted breadcrumbs.
+     */
+    void push(std::int64_t timestamp,
+              string_ref message,
+              string_ref level,
+              string_ref type,
+              string_ref category,
+              string_ref data);
+
+    /// remove all breadcrumbs
+    void clear();
+
+    /// the number of stored breadcrumbs
+    std::size_t size() const;
+
+    /// the size of the text of the stored breadcrumbs
+    std::size_t bytes() const;
+
+    /*!
+     * @brief append the stored breadcrumbs to an array, oldest first
+     * @param[in,out] values the array to append to
+     * @param[in] since only append breadcrumbs with this timestamp or later
+     */
+    void append_to(json& values, std::int64_t since = (std::numeric_limits<std::int64_t>::min)()) const;
+
+    /*!
+     * @brief append the timestamps of the stored breadcrumbs, oldest first
+     * @param[in,out] timestamps the vector to append to
+     */
+    void append_timestamps(std::vector<std::int64_t>& timestamps) const;
+
+    /*!
+     * @brief move all breadcrumbs to the end of another buffer
+     * @param[in,out] target the buffer to add the breadcrumbs to
+     * @post this buffer is empty
+     */
+    void move_to(breadcrumb_buffer& target);
+
+  private:
+    /// a stored breadcrumb
+    struct record
+    {
+        /// the time of the breadcrumb (microseconds since epoch)
+        std::int64_t timestamp = 0;
+        /// the position of the text in m_text
+        std::size_t text = 0;
+        /// the size of the message
+        std::size_t message_size = 0;
+        /// the size of the serialized data (0: no data)
+        std::size_t data_size = 0;
+        /// interned level
+        std::uint32_t level = 0;
+        /// interned type
+        std::uint32_t type = 0;
+        /// interned category
+        std::uint32_t category = 0;
+    };
+
+    /// an interned string
+    struct interned_string
+    {
+        /// the string
+        std::string value;
+        /// the number of records using the string (0: the slot can be reused)
+        std::size_t references = 0;
+    };
+
+    /// remove the oldest breadcrumb
+    void pop();
+
+    /// return the record in a slot, counted from the oldest breadcrumb
+    const record& at(std::size_t index) const;
+
+    /// return the message of a record
+    std::string message(const record& r) const;
+
+    /// return the serialized data of a record
+    std::string data(const record& r) const;
+
+    /// return the id of a string, interning it if needed
+    std::uint32_t intern(string_ref value);
+
+    /// copy text to the end of the text ring and return its position
+    std::size_t write_text(string_ref text);
+
+    /// read text from the text ring
+    std::string read_text(std::size_t position, std::size_t size) const;
+
+    /// make room for a given number of additional text bytes
+    void reserve_text(std::size_t size);
+
+    /// the slots of the ring (its size is the maximal number of breadcrumbs)
+    std::vector<record> m_records;
+    /// the maximal size of the text (0: unlimited)
+    std::size_t m_max_bytes;
+    /// the slot of the oldest breadcrumb
+    std::size_t m_first = 0;
+    /// the number of stored breadcrumbs
+    std::size_t m_size = 0;
+
+    /// the ring of characters with the text of the breadcrumbs
+    std::vector<char> m_text;
+    /// the position of the oldest text
+    std::size_t m_text_first = 0;
+    /// the number of used characters in m_text
+    std::size_t m_text_size = 0;
+
+    /// the interned levels, types, and categories
+    std::vector<interned_string> m_strings;
+};
+
+/*!
+ * @brief a breadcrumb buffer written by one thread and read by the threads capturing events
+ *
+ * The lock is only contended while an event is captured, which copies the
+ * buffer and converts the copy to JSON after releasing the lock.
+ */
+struct shared_breadcrumb_buffer
+{
+    /// the lock for buffer
+    std::mutex mutex;
+    /// the breadcrumbs
+    breadcrumb_buffer buffer;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,710 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file crow_dwarf.cpp
+ * @brief implementation of the DWARF line tables
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <src/crow_dwarf.hpp>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+namespace
+{
+// DWARF constants, see http://dwarfstd.org/doc/DWARF5.pdf
+constexpr std::uint8_t DW_LNS_copy = 0x01;
+constexpr std::uint8_t DW_LNS_advance_pc = 0x02;
+constexpr std::uint8_t DW_LNS_advance_line = 0x03;
+constexpr std::uint8_t DW_LNS_set_file = 0x04;
+constexpr std::uint8_t DW_LNS_const_add_pc = 0x08;
+constexpr std::uint8_t DW_LNS_fixed_advance_pc = 0x09;
+constexpr std::uint8_t DW_LNE_end_sequence = 0x01;
+constexpr std::uint8_t DW_LNE_set_address = 0x02;
+constexpr std::uint8_t DW_LNE_define_file = 0x03;
+constexpr std::uint64_t DW_LNCT_path = 0x1;
+constexpr std::uint64_t DW_LNCT_directory_index = 0x2;
+constexpr std::uint64_t DW_FORM_data2 = 0x05;
+constexpr std::uint64_t DW_FORM_data4 = 0x06;
+constexpr std::uint64_t DW_FORM_data8 = 0x07;
+constexpr std::uint64_t DW_FORM_string = 0x08;
+constexpr std::uint64_t DW_FORM_block = 0x09;
+constexpr std::uint64_t DW_FORM_block1 = 0x0a;
+constexpr std::uint64_t DW_FORM_data1 = 0x0b;
+constexpr std::uint64_t DW_FORM_strp = 0x0e;
+constexpr std::uint64_t DW_FORM_udata = 0x0f;
+constexpr std::uint64_t DW_FORM_data16 = 0x1e;
+constexpr std::uint64_t DW_FORM_line_strp = 0x1f;
+
+/// the file id of rows without a known file
+constexpr std::uint32_t no_file = (std::numeric_limits<std::uint32_t>::max)();
+
+/*!
+ * @brief a bounds-checked cursor over a section
+ *
+ * Reading past the end sets a flag and returns zeros, so a parser only has
+ * to check ok() once in a while.
+ */
+class reader
+{
+  public:
+    reader(const unsigned char* data, const std::size_t size, const std::size_t position)
+        : m_data(data), m_size(size), m_position(position)
+    {}
+
+    /// whether all reads were within the section
+    bool ok() const
+    {
+        return not m_failed;
+    }
+
+    /// whether the end of the section is reached
+    bool at_end() const
+    {
+        return m_position >= m_size;
+    }
+
+    /// the current offset
+    std::size_t position() const
+    {
+        return m_position;
+    }
+
+    /// skip a number of bytes
+    void skip(const std::uint64_t size)
+    {
+        if (size > m_size - m_position)
+        {
+            m_failed = true;
+            m_position = m_size;
+            return;
+        }
+        m_position += static_cast<std::size_t>(size);
+    }
+
+    /// read an unsigned integer of 1, 2, 4, or 8 bytes in the byte order of the process
+    std::uint64_t fixed(const std::size_t size)
+    {
+        if (size > m_size - m_position)
+        {
+            skip(size);
+            return 0;
+        }
+
+        std::uint64_t result = 0;
+        switch (size)
+        {
+            case 1:
+            {
+                result = m_data[m_position];
+                break;
+            }
+            case 2:
+            {
+                std::uint16_t value;
+                std::memcpy(&value, m_data + m_position, size);
+                result = value;
+                break;
+            }
+            case 4:
+            {
+                std::uint32_t value;
+                std::memcpy(&value, m_data + m_position, size);
+                result = value;
+                break;
+            }
+            case 8:
+            {
+                std::memcpy(&result, m_data + m_position, size);
+                break;
+            }
+            default:
+            {
+                m_failed = true;
+                break;
+            }
+        }
+        m_position += size;
+        return result;
+    }
+
+    /// read an unsigned LEB128 number
+    std::uint64_t uleb()
+    {
+        std::uint64_t result = 0;
+        unsigned shift = 0;
+        while (m_position < m_size)
+        {
+            const std::uint8_t byte = m_data[m_position++];
+            if (shift < 64)
+            {
+                result |= static_cast<std::uint64_t>(byte & 0x7fu) << shift;
+            }
+            shift += 7;
+            if ((byte & 0x80u) == 0)
+            {
+                return result;
+            }
+        }
+        m_failed = true;
+        return 0;
+    }
+
+    /// read a signed LEB128 number
+    std::int64_t sleb()
+    {
+        std::uint64_t result = 0;
+        unsigned shift = 0;
+        while (m_position < m_size)
+        {
+            const std::uint8_t byte = m_data[m_position++];
+            if (shift < 64)
+            {
+                result |= static_cast<std::uint64_t>(byte & 0x7fu) << shift;
+            }
+            shift += 7;
+            if ((byte & 0x80u) == 0)
+            {
+                if (shift < 64 and (byte & 0x40u) != 0)
+                {
+                    result |= ~std::uint64_t(0) << shift;
+                }
+                return static_cast<std::int64_t>(result);
+            }
+        }
+        m_failed = true;
+        return 0;
+    }
+
+    /// read a null-terminated string
+    const char* string()
+    {
+        const void* end = std::memchr(m_data + m_position, '\0', m_size - m_position);
+        if (end == nullptr)
+        {
+            m_failed = true;
+            m_position = m_size;
+            return "";
+        }
+        const auto* result = reinterpret_cast<const char*>(m_data + m_position);
+        m_position = static_cast<std::size_t>(static_cast<const unsigned char*>(end) - m_data) + 1;
+        return result;
+    }
+
+  private:
+    /// the section
+    const unsigned char* m_data;
+    /// the size of the section
+    std::size_t m_size;
+    /// the current offset
+    std::size_t m_position;
+    /// whether a read went past the end
+    bool m_failed = false;
+};
+
+/// return the null-terminated string at an offset of a string section, or an empty string
+std::string string_at(const elf_module::section_data& section, const std::uint64_t offset)
+{
+    if (section.data == nullptr or offset >= section.size
+            or std::memchr(section.data + offset, '\0', section.size - static_cast<std::size_t>(offset)) == nullptr)
+    {
+        return "";
+    }
+    return reinterpret_cast<const char*>(section.data + offset);
+}
+
+/// join a directory and a file name
+std::string join_path(const std::string& directory, const std::string& name)
+{
+    if (directory.empty() or name.empty() or name[0] == '/')
+    {
+        return name;
+    }
+    return directory.back() == '/' ? directory + name : directory + "/" + name;
+}
+
+/*!
+ * @brief read the directory or file table of a DWARF 5 line table header
+ * @param[in,out] unit the reader, positioned at the entry formats
+ * @param[in] offset_size the size of section offsets (4 or 8)
+ * @param[in] line_strings the contents of .debug_line_str
+ * @param[in] strings the contents of .debug_str
+ * @param[out] entries the paths and directory indices of the entries
+ * @return false if the table uses an unsupported form
+ */
+bool read_entry_table(reader& unit,
+                      const std::size_t offset_size,
+                      const elf_module::section_data& line_strings,
+                      const elf_module::section_data& strings,
+                      std::vector<std::pair<std::string, std::uint64_t>>& entries)
+{
+    // pairs of content type (DW_LNCT_*) and form (DW_FORM_*)
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> formats(static_cast<std::size_t>(unit.fixed(1)));
+    for (auto& format : formats)
+    {
+        format.first = unit.uleb();
+        format.second = unit.uleb();
+    }
+
+    const std::uint64_t count = unit.uleb();
+    for (std::uint64_t i = 0; i < count and unit.ok(); ++i)
+    {
+        std::pair<std::string, std::uint64_t> entry;
+        for (const auto& format : formats)
+        {
+            std::string text;
+            std::uint64_t number = 0;
+            switch (format.second)
+            {
+                case DW_FORM_string:
+                    text = unit.string();
+                    break;
+                case DW_FORM_line_strp:
+                    text = string_at(line_strings, unit.fixed(offset_size));
+                    break;
+                case DW_FORM_strp:
+                    text = string_at(strings, unit.fixed(offset_size));
+                    break;
+                case DW_FORM_data1:
+                    number = unit.fixed(1);
+                    break;
+                case DW_FORM_data2:
+                    number = unit.fixed(2);
+                    break;
+                case DW_FORM_data4:
+                    number = unit.fixed(4);
+                    break;
+                case DW_FORM_data8:
+                    number = unit.fixed(8);
+                    break;
+                case DW_FORM_udata:
+                    number = unit.uleb();
+                    break;
+                case DW_FORM_data16:
+                    unit.skip(16);
+                    break;
+                case DW_FORM_block:
+                    unit.skip(unit.uleb());
+                    break;
+                case DW_FORM_block1:
+                    unit.skip(unit.fixed(1));
+                    break;
+                default:
+                    // e.g. DW_FORM_strx, which would need .debug_str_offsets
+                    return false;
+            }
+
+            if (format.first == DW_LNCT_path)
+            {
+                entry.first = std::move(text);
+            }
+            else if (format.first == DW_LNCT_directory_index)
+            {
+                entry.second = number;
+            }
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    return unit.ok();
+}
+}
+
+std::shared_ptr<const line_table> line_table::load(const elf_module& module)
+{
+    debug_sections sections;
+    sections.line = module.find_section(".debug_line");
+    sections.line_strings = module.find_section(".debug_line_str");
+    sections.strings = module.find_section(".debug_str");
+    if (sections.line.data == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<line_table> result(new line_table);
+    result->m_link_base = module.link_base();
+
+    std::map<std::string, std::uint32_t> file_ids;
+    std::size_t offset = 0;
+    while (offset < sections.line.size)
+    {
+        offset = result->parse_unit(sections, offset, file_ids);
+        if (offset == 0)
+        {
+            break;
+        }
+    }
+
+    if (result->m_rows.empty())
+    {
+        return nullptr;
+    }
+
+    // the end of a sequence goes first, so a sequence starting at the same address wins
+    std::stable_sort(result->m_rows.begin(), result->m_rows.end(), [](const row & lhs, const row & rhs)
+    {
+        return lhs.address < rhs.address or (lhs.address == rhs.address and lhs.line == 0 and rhs.line != 0);
+    });
+    result->m_rows.shrink_to_fit();
+
+    return result;
+}
+
+std::size_t line_table::parse_unit(const debug_sections& sections,
+                                   const std::size_t offset,
+                                   std::map<std::string, std::uint32_t>& file_ids)
+{
+    reader header(sections.line.data, sections.line.size, offset);
+
+    // the header, see section 6.2.4 of DWARF 5
+    std::uint64_t unit_length = header.fixed(4);
+    const bool dwarf64 = (unit_length == 0xffffffffu);
+    if (dwarf64)
+    {
+        unit_length = header.fixed(8);
+    }
+    if (not header.ok() or unit_length > sections.line.size - header.position())
+    {
+        return 0;
+    }
+    const std::size_t unit_end = header.position() + static_cast<std::size_t>(unit_length);
+    const std::size_t offset_size = dwarf64 ? 8 : 4;
+
+    reader unit(sections.line.data, unit_end, header.position());
+    const std::uint64_t version = unit.fixed(2);
+    if (version < 2 or version > 5)
+    {
+        return unit_end;
+    }
+
+    std::size_t address_size = sizeof(std::uintptr_t);
+    if (version >= 5)
+    {
+        address_size = static_cast<std::size_t>(unit.fixed(1));
+        unit.skip(1); // segment_selector_size
+    }
+
+    const std::uint64_t header_length = unit.fixed(offset_size);
+    const std::size_t program_begin = unit.position() + static_cast<std::size_t>(header_length);
+    const std::uint64_t minimum_instruction_length = unit.fixed(1);
+    if (version >= 4)
+    {
+        unit.skip(1); // maximum_operations_per_instruction
+    }
+    unit.skip(1); // default_is_stmt
+    const auto line_base = static_cast<std::int8_t>(unit.fixed(1));
+    const std::uint64_t line_range = unit.fixed(1);
+    const std::uint64_t opcode_base = unit.fixed(1);
+    std::vector<std::uint64_t> standard_opcode_lengths(1);
+    for (std::uint64_t opcode = 1; opcode < opcode_base; ++opcode)
+    {
+        standard_opcode_lengths.push_back(unit.fixed(1));
+    }
+    if (not unit.ok() or line_range == 0 or opcode_base == 0 or program_begin > unit_end)
+    {
+        return unit_end;
+    }
+
+    // the ids of the unit's files in m_files, indexed by DWARF file number
+    std::vector<std::uint32_t> files;
+    const auto add_file = [this, &file_ids, &files](const std::string & filename)
+    {
+        const auto it = file_ids.emplace(filename, static_cast<std::uint32_t>(m_files.size()));
+        if (it.second)
+        {
+            m_files.push_back(filename);
+        }
+        files.push_back(it.first->second);
+    };
+
+    if (version >= 5)
+    {
+        std::vector<std::pair<std::string, std::uint64_t>> directories;
+        std::vector<std::pair<std::string, std::uint64_t>> file_entries;
+        if (not read_entry_table(unit, offset_size, sections.line_strings, sections.strings, directories)
+                or not read_entry_table(unit, offset_size, sections.line_strings, sections.strings, file_entries))
+        {
+            return unit_end;
+        }
+
+        for (const auto& entry : file_entries)
+        {
+            add_file(join_path(entry.second < directories.size() ? directories[static_cast<std::size_t>(entry.second)].first : "",
+                               entry.first));
+        }
+    }
+    else
+    {
+        // directory 0 is the compilation directory, which is only named in .debug_info
+        std::vector<std::string> directories(1);
+        for (const char* directory = unit.string(); unit.ok() and directory[0] != '\0'; directory = unit.string())
+        {
+            directories.emplace_back(directory);
+        }
+
+        // file numbers start at 1
+        files.push_back(no_file);
+        for (const char* name = unit.string(); unit.ok() and name[0] != '\0'; name = unit.string())
+        {
+            const std::uint64_t directory = unit.uleb();
+            unit.uleb(); // modification time
+            unit.uleb(); // file size
+            add_file(join_path(directory < directories.size() ? directories[static_cast<std::size_t>(directory)] : "", name));
+        }
+    }
+
+    if (not unit.ok())
+    {
+        return unit_end;
+    }
+
+    // the line number program, see section 6.2.5 of DWARF 5
+    reader program(sections.line.data, unit_end, program_begin);
+    std::uintptr_t address = 0;
+    std::uint64_t file = 1;
+    std::int64_t line = 1;
+    std::size_t sequence_begin = m_rows.size();
+
+    const auto append_row = [&](const bool end_sequence)
+    {
+        row r = {address, no_file, 0};
+        if (not end_sequence and file < files.size() and line > 0 and line <= (std::numeric_limits<std::uint32_t>::max)())
+        {
+            r.file = files[static_cast<std::size_t>(file)];
+            r.line = r.file != no_file ? static_cast<std::uint32_t>(line) : 0;
+        }
+
+        if (m_rows.size() > sequence_begin)
+        {
+            row& last = m_rows.back();
+            if (last.address == r.address)
+            {
+                // only the last row for an address is used
+                last = r;
+                return;
+            }
+            if (not end_sequence and last.file == r.file and last.line == r.line)
+            {
+                // the previous row already covers this address
+                return;
+            }
+        }
+        m_rows.push_back(r);
+    };
+
+    while (not program.at_end() and program.ok())
+    {
+        const std::uint64_t opcode = program.fixed(1);
+        if (opcode >= opcode_base)
+        {
+            // special opcode
+            const std::uint64_t adjusted = opcode - opcode_base;
+            address += static_cast<std::uintptr_t>(adjusted / line_range * minimum_instruction_length);
+            line += line_base + static_cast<std::int64_t>(adjusted % line_range);
+            append_row(false);
+            continue;
+        }
+
+        switch (opcode)
+        {
+            case 0:
+            {
+                // extended opcode
+                const std::uint64_t length = program.uleb();
+                const std::size_t end = program.position() + static_cast<std::size_t>(length);
+                if (length == 0 or length > unit_end - program.position())
+                {
+                    return unit_end;
+                }
+
+                switch (program.fixed(1))
+                {
+                    case DW_LNE_end_sequence:
+                    {
+                        append_row(true);
+                        if (m_rows[sequence_begin].address == 0)
+                        {
+                            // code removed by the linker
+                            m_rows.resize(sequence_begin);
+                        }
+                        sequence_begin = m_rows.size();
+                        address = 0;
+                        file = 1;
+                        line = 1;
+                        break;
+                    }
+                    case DW_LNE_set_address:
+                    {
+                        address = static_cast<std::uintptr_t>(program.fixed(address_size));
+                        break;
+                    }
+                    case DW_LNE_define_file:
+                    {
+                        // the directory, modification time, and size are skipped with the opcode
+                        add_file(program.string());
+                        break;
+                    }
+                    default:
+                    {
+                        break;
+                    }
+                }
+
+                program = reader(sections.line.data, unit_end, end);
+                break;
+            }
+            case DW_LNS_copy:
+            {
+                append_row(false);
+                break;
+            }
+            case DW_LNS_advance_pc:
+            {
+                address += static_cast<std::uintptr_t>(program.uleb() * minimum_instruction_length);
+                break;
+            }
+            case DW_LNS_advance_line:
+            {
+                line += program.sleb();
+                break;
+            }
+            case DW_LNS_set_file:
+            {
+                file = program.uleb();
+                break;
+            }
+            case DW_LNS_const_add_pc:
+            {
+                address += static_cast<std::uintptr_t>((255 - opcode_base) / line_range * minimum_instruction_length);
+                break;
+            }
+            case DW_LNS_fixed_advance_pc:
+            {
+                address += static_cast<std::uintptr_t>(program.fixed(2));
+                break;
+            }
+            default:
+            {
+                // opcodes that do not affect file and line, e.g. DW_LNS_set_column
+                for (std::uint64_t i = 0; i < standard_opcode_lengths[static_cast<std::size_t>(opcode)]; ++i)
+                {
+                    program.uleb();
+                }
+                break;
+            }
+        }
+    }
+
+    return unit_end;
+}
+
+line_table::location line_table::find(const std::uintptr_t address, const std::uintptr_t load_address) const
+{
+    location result;
+
+    // the frames hold return addresses, so look up the call instruction before
+    const std::uintptr_t relative_address = address - 1 - load_address + m_link_base;
+
+    auto it = std::upper_bound(m_rows.begin(), m_rows.end(), relative_address,
+                               [](const std::uintptr_t value, const row & r)
+    {
+        return value < r.address;
+    });
+    if (it == m_rows.begin())
+    {
+        return result;
+    }
+
+    --it;
+    if (it->line != 0 and it->file < m_files.size())
+    {
+        result.filename = m_files[it->file];
+        result.line = it->line;
+    }
+    return result;
+}
+
+std::size_t line_table::size() const
+{
+    return m_rows.size();
+}
+
+std::shared_ptr<const line_table> get_line_table(const std::string& path)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_future<std::shared_ptr<const line_table>>> tables;
+
+    // the first caller reads the table without the lock; later callers wait for its result
+    std::promise<std::shared_ptr<const line_table>> promise;
+    std::shared_future<std::shared_ptr<const line_table>> result;
+    bool load = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = tables.find(path);
+        if (it == tables.end())
+        {
+            it = tables.emplace(path, promise.get_future().share()).first;
+            load = true;
+        }
+        result = it->second;
+    }
+
+    if (load)
+    {
+        std::shared_ptr<const line_table> table;
+        try
+        {
+            const auto module = get_elf_module(path);
+            if (module)
+            {
+                table = line_table::load(*module);
+            }
+        }
+        catch (const std::exception&)
+        {
+            // treated like a module without line information
+        }
+        promise.set_value(std::move(table));
+    }
+
+    return result.get();
+}
+
+}
+}
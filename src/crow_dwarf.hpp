@@ -0,0 +1,147 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef NLOHMANN_CROW_DWARF_HPP
+#define NLOHMANN_CROW_DWARF_HPP
+
+/*!
+ * @file crow_dwarf.hpp
+ * @brief source locations from DWARF line tables
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <src/crow_elf.hpp>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+/*!
+ * @brief the address to line mapping of an executable or shared library
+ *
+ * The line number programs of the .debug_line section (DWARF 2 to 5) are
+ * run once and their rows are stored sorted by address, so a source
+ * location is found with a binary search. File names are stored once.
+ *
+ * @note Compressed debug sections and split DWARF are not supported.
+ */
+class line_table
+{
+  public:
+    /// a source location
+    struct location
+    {
+        /// the path of the source file (empty: unknown)
+        std::string filename;
+        /// the line number (0: unknown)
+        std::uint32_t line = 0;
+    };
+
+    /*!
+     * @brief read the line tables of a module
+     * @param[in] module the mapped module
+     * @return the table, or nullptr if the module has no usable .debug_line section
+     */
+    static std::shared_ptr<const line_table> load(const elf_module& module);
+
+    /*!
+     * @brief find the source location of an instruction
+     * @param[in] address an instruction address in the running process
+     * @param[in] load_address the address the module is loaded at (dli_fbase)
+     * @return the location, or an empty location if the address is not covered
+     */
+    location find(std::uintptr_t address, std::uintptr_t load_address) const;
+
+    /// the number of rows
+    std::size_t size() const;
+
+  private:
+    /// a row of the line table
+    struct row
+    {
+        /// the first address of the row, relative to the link base
+        std::uintptr_t address;
+        /// the index of the file in m_files
+        std::uint32_t file;
+        /// the line (0: the end of a sequence)
+        std::uint32_t line;
+    };
+
+    /// the sections with line information
+    struct debug_sections
+    {
+        /// the line number programs
+        elf_module::section_data line;
+        /// the strings referenced by DW_FORM_line_strp
+        elf_module::section_data line_strings;
+        /// the strings referenced by DW_FORM_strp
+        elf_module::section_data strings;
+    };
+
+    line_table() = default;
+
+    /*!
+     * @brief run the line number program of one unit
+     * @param[in] sections the sections of the module
+     * @param[in] offset the offset of the unit in .debug_line
+     * @param[in,out] file_ids the indices of the file names in m_files
+     * @return the offset of the next unit, or 0 if the unit is malformed
+     */
+    std::size_t parse_unit(const debug_sections& sections,
+                           std::size_t offset,
+                           std::map<std::string, std::uint32_t>& file_ids);
+
+    /// the virtual address the module header is linked at
+    std::uintptr_t m_link_base = 0;
+    /// the rows, sorted by address
+    std::vector<row> m_rows;
+    /// the file names
+    std::vector<std::string> m_files;
+};
+
+/*!
+ * @brief return the line table of a module, reading it on first use
+ * @param[in] path the file of the module, see resolved_symbol::file
+ * @return the table, or nullptr if the module has no line information
+ * @note Tables are kept until the process ends. Failures are remembered.
+ * @note Reading a table does not block lookups of other modules;
+ *       concurrent lookups of the module wait for the first one.
+ */
+std::shared_ptr<const line_table> get_line_table(const std::string& path);
+
+}
+}
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file crow_elf.cpp
+ * @brief implementation of the ELF symbol index
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <map>
+#include <mutex>
+#include <src/crow_config.hpp>
+#include <src/crow_elf.hpp>
+
+#if defined(NLOHMANN_CROW_HAVE_ELF_H) && defined(NLOHMANN_CROW_HAVE_SYS_MMAN_H)
+    #define NLOHMANN_CROW_ELF_SUPPORT
+    #include <elf.h> // for Elf64_Ehdr, Elf64_Shdr, Elf64_Sym
+    #include <fcntl.h> // for open
+    #include <sys/mman.h> // for mmap, munmap
+    #include <sys/stat.h> // for fstat
+    #include <unistd.h> // for close
+#endif
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+#ifdef NLOHMANN_CROW_ELF_SUPPORT
+namespace
+{
+// the ELF class of the running process
+#if UINTPTR_MAX > 0xffffffffu
+using elf_header = Elf64_Ehdr;
+using elf_program_header = Elf64_Phdr;
+using elf_section_header = Elf64_Shdr;
+using elf_symbol = Elf64_Sym;
+constexpr unsigned char elf_class = ELFCLASS64;
+#else
+using elf_header = Elf32_Ehdr;
+using elf_program_header = Elf32_Phdr;
+using elf_section_header = Elf32_Shdr;
+using elf_symbol = Elf32_Sym;
+constexpr unsigned char elf_class = ELFCLASS32;
+#endif
+
+/// whether a range of a given size starting at an offset lies inside a file
+bool in_bounds(const std::size_t file_size, const std::uintptr_t offset, const std::uintptr_t size)
+{
+    return offset <= file_size and size <= file_size - offset;
+}
+}
+#endif
+
+std::shared_ptr<const elf_module> elf_module::load(const std::string& path)
+{
+#ifdef NLOHMANN_CROW_ELF_SUPPORT
+    const int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file == -1)
+    {
+        return nullptr;
+    }
+
+    struct stat file_stat;
+    void* mapping = MAP_FAILED;
+    if (::fstat(file, &file_stat) == 0 and file_stat.st_size > 0)
+    {
+        mapping = ::mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    // the mapping stays valid after the file is closed
+    ::close(file);
+
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<elf_module> result(new elf_module);
+    result->m_data = static_cast<const unsigned char*>(mapping);
+    result->m_size = static_cast<std::size_t>(file_stat.st_size);
+
+    if (not result->parse())
+    {
+        return nullptr;
+    }
+
+    return result;
+#else
+    static_cast<void>(path);
+    return nullptr;
+#endif
+}
+
+elf_module::~elf_module()
+{
+#ifdef NLOHMANN_CROW_ELF_SUPPORT
+    if (m_data != nullptr)
+    {
+        ::munmap(const_cast<unsigned char*>(m_data), m_size);
+    }
+#endif
+}
+
+bool elf_module::parse()
+{
+#ifdef NLOHMANN_CROW_ELF_SUPPORT
+    if (not in_bounds(m_size, 0, sizeof(elf_header)))
+    {
+        return false;
+    }
+
+    elf_header header;
+    std::memcpy(&header, m_data, sizeof(header));
+    if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 or header.e_ident[EI_CLASS] != elf_class)
+    {
+        return false;
+    }
+
+    // the file header is mapped with the first loadable segment
+    if (header.e_phentsize != sizeof(elf_program_header)
+            or not in_bounds(m_size, header.e_phoff, static_cast<std::uintptr_t>(header.e_phnum) * sizeof(elf_program_header)))
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < header.e_phnum; ++i)
+    {
+        elf_program_header segment;
+        std::memcpy(&segment, m_data + header.e_phoff + i * sizeof(segment), sizeof(segment));
+        if (segment.p_type == PT_LOAD)
+        {
+            m_link_base = segment.p_vaddr - segment.p_offset;
+            break;
+        }
+    }
+
+    if (header.e_shentsize != sizeof(elf_section_header)
+            or not in_bounds(m_size, header.e_shoff, static_cast<std::uintptr_t>(header.e_shnum) * sizeof(elf_section_header)))
+    {
+        return false;
+    }
+
+    const auto section = [this, &header](const std::size_t index)
+    {
+        elf_section_header result;
+        std::memcpy(&result, m_data + header.e_shoff + index * sizeof(result), sizeof(result));
+        return result;
+    };
+
+    for (std::size_t i = 0; i < header.e_shnum; ++i)
+    {
+        const elf_section_header symbols = section(i);
+        if ((symbols.sh_type != SHT_SYMTAB and symbols.sh_type != SHT_DYNSYM)
+                or symbols.sh_entsize != sizeof(elf_symbol)
+                or symbols.sh_link >= header.e_shnum
+                or not in_bounds(m_size, symbols.sh_offset, symbols.sh_size))
+        {
+            continue;
+        }
+
+        const elf_section_header strings = section(symbols.sh_link);
+        if (strings.sh_size == 0 or not in_bounds(m_size, strings.sh_offset, strings.sh_size)
+                or m_data[strings.sh_offset + strings.sh_size - 1] != '\0')
+        {
+            continue;
+        }
+
+        const auto* names = reinterpret_cast<const char*>(m_data + strings.sh_offset);
+        for (std::uintptr_t offset = 0; offset + sizeof(elf_symbol) <= symbols.sh_size; offset += sizeof(elf_symbol))
+        {
+            elf_symbol symbol;
+            std::memcpy(&symbol, m_data + symbols.sh_offset + offset, sizeof(symbol));
+            // the type is in the lower four bits for both ELF classes
+            if ((symbol.st_info & 0xfu) != STT_FUNC or symbol.st_shndx == SHN_UNDEF
+                    or symbol.st_value == 0 or symbol.st_name == 0 or symbol.st_name >= strings.sh_size)
+            {
+                continue;
+            }
+
+            m_functions.push_back({static_cast<std::uintptr_t>(symbol.st_value),
+                                   static_cast<std::uintptr_t>(symbol.st_size),
+                                   names + symbol.st_name});
+        }
+    }
+
+    // sort by address, and keep only the largest of several functions at one address
+    std::sort(m_functions.begin(), m_functions.end(), [](const function & lhs, const function & rhs)
+    {
+        return lhs.address < rhs.address or (lhs.address == rhs.address and lhs.size > rhs.size);
+    });
+    m_functions.erase(std::unique(m_functions.begin(), m_functions.end(), [](const function & lhs, const function & rhs)
+    {
+        return lhs.address == rhs.address;
+    }), m_functions.end());
+    m_functions.shrink_to_fit();
+
+    return not m_functions.empty();
+#else
+    return false;
+#endif
+}
+
+const char* elf_module::find_function(const std::uintptr_t address, const std::uintptr_t load_address) const
+{
+    const std::uintptr_t relative_address = address - load_address + m_link_base;
+
+    auto it = std::upper_bound(m_functions.begin(), m_functions.end(), relative_address,
+                               [](const std::uintptr_t value, const function & f)
+    {
+        return value < f.address;
+    });
+    if (it == m_functions.begin())
+    {
+        return nullptr;
+    }
+
+    --it;
+    if (it->size != 0 and relative_address - it->address >= it->size)
+    {
+        return nullptr;
+    }
+
+    return it->name;
+}
+
+std::size_t elf_module::size() const
+{
+    return m_functions.size();
+}
+
+elf_module::section_data elf_module::find_section(const char* name) const
+{
+    section_data result;
+
+#ifdef NLOHMANN_CROW_ELF_SUPPORT
+    // the headers were validated by parse()
+    elf_header header;
+    std::memcpy(&header, m_data, sizeof(header));
+    if (header.e_shstrndx == SHN_UNDEF or header.e_shstrndx >= header.e_shnum)
+    {
+        return result;
+    }
+
+    const auto section = [this, &header](const std::size_t index)
+    {
+        elf_section_header result;
+        std::memcpy(&result, m_data + header.e_shoff + index * sizeof(result), sizeof(result));
+        return result;
+    };
+
+    const elf_section_header names = section(header.e_shstrndx);
+    if (names.sh_size == 0 or not in_bounds(m_size, names.sh_offset, names.sh_size)
+            or m_data[names.sh_offset + names.sh_size - 1] != '\0')
+    {
+        return result;
+    }
+
+    for (std::size_t i = 0; i < header.e_shnum; ++i)
+    {
+        const elf_section_header candidate = section(i);
+        if (candidate.sh_name >= names.sh_size
+                or std::strcmp(reinterpret_cast<const char*>(m_data + names.sh_offset + candidate.sh_name), name) != 0)
+        {
+            continue;
+        }
+
+        if (candidate.sh_type != SHT_NOBITS and (candidate.sh_flags & SHF_COMPRESSED) == 0
+                and in_bounds(m_size, candidate.sh_offset, candidate.sh_size))
+        {
+            result.data = m_data + candidate.sh_offset;
+            result.size = static_cast<std::size_t>(candidate.sh_size);
+        }
+        break;
+    }
+#else
+    static_cast<void>(name);
+#endif
+
+    return result;
+}
+
+std::uintptr_t elf_module::link_base() const
+{
+    return m_link_base;
+}
+
+std::shared_ptr<const elf_module> get_elf_module(const std::string& path)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_future<std::shared_ptr<const elf_module>>> modules;
+
+    // the first caller indexes the module without the lock; later callers wait for its result
+    std::promise<std::shared_ptr<const elf_module>> promise;
+    std::shared_future<std::shared_ptr<const elf_module>> result;
+    bool load = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = modules.find(path);
+        if (it == modules.end())
+        {
+            it = modules.emplace(path, promise.get_future().share()).first;
+            load = true;
+        }
+        result = it->second;
+    }
+
+    if (load)
+    {
+        std::shared_ptr<const elf_module> module;
+        try
+        {
+            module = elf_module::load(path);
+        }
+        catch (const std::exception&)
+        {
+            // treated like a file that cannot be indexed
+        }
+        promise.set_value(std::move(module));
+    }
+
+    return result.get();
+}
+
+}
+}
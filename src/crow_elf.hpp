@@ -0,0 +1,146 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef NLOHMANN_CROW_ELF_HPP
+#define NLOHMANN_CROW_ELF_HPP
+
+/*!
+ * @file crow_elf.hpp
+ * @brief symbol tables of ELF files
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+/*!
+ * @brief the function symbols of an executable or shared library
+ *
+ * The file is mapped into memory and the functions of its .symtab and
+ * .dynsym sections are sorted by address, so functions that dladdr cannot
+ * name (static, hidden, or not exported from an executable) can be found
+ * with a binary search. The names point into the mapping and are not
+ * copied.
+ */
+class elf_module
+{
+  public:
+    /// the contents of a section inside the mapping
+    struct section_data
+    {
+        /// the first byte of the section (nullptr: the section does not exist)
+        const unsigned char* data = nullptr;
+        /// the size of the section in bytes
+        std::size_t size = 0;
+    };
+
+    /*!
+     * @brief map and index an ELF file
+     * @param[in] path the path of the file
+     * @return the index, or nullptr if the file cannot be read or is no ELF
+     *         file of this architecture
+     */
+    static std::shared_ptr<const elf_module> load(const std::string& path);
+
+    ~elf_module();
+
+    elf_module(const elf_module&) = delete;
+    elf_module& operator=(const elf_module&) = delete;
+
+    /*!
+     * @brief find the function containing an address
+     * @param[in] address an instruction address in the running process
+     * @param[in] load_address the address the file is loaded at (dli_fbase)
+     * @return the mangled name of the function, or nullptr if no function
+     *         contains the address
+     */
+    const char* find_function(std::uintptr_t address, std::uintptr_t load_address) const;
+
+    /// the number of indexed functions
+    std::size_t size() const;
+
+    /*!
+     * @brief return the contents of a section
+     * @param[in] name the name of the section, e.g. ".debug_line"
+     * @return the contents, or an empty section_data if the file has no such
+     *         section or it is compressed
+     */
+    section_data find_section(const char* name) const;
+
+    /// the virtual address the file header is linked at
+    std::uintptr_t link_base() const;
+
+  private:
+    /// a function symbol
+    struct function
+    {
+        /// the start address of the function, relative to the link base
+        std::uintptr_t address;
+        /// the size of the function in bytes (0: unknown)
+        std::uintptr_t size;
+        /// the null-terminated name inside the mapping
+        const char* name;
+    };
+
+    elf_module() = default;
+
+    /// read the symbol tables from the mapping
+    bool parse();
+
+    /// the mapped file
+    const unsigned char* m_data = nullptr;
+    /// the size of the mapped file
+    std::size_t m_size = 0;
+    /// the virtual address the file header is linked at
+    std::uintptr_t m_link_base = 0;
+    /// the functions, sorted by address
+    std::vector<function> m_functions;
+};
+
+/*!
+ * @brief return the index of a loaded module, building it on first use
+ * @param[in] path the file of the module, see resolved_symbol::file
+ * @return the index, or nullptr if the module cannot be indexed
+ * @note Indexes are kept until the process ends. Failures are remembered.
+ * @note Indexing a module does not block lookups of other modules;
+ *       concurrent lookups of the module wait for the first one.
+ */
+std::shared_ptr<const elf_module> get_elf_module(const std::string& path);
+
+}
+}
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file crow_rate_limiter.cpp
+ * @brief implementation of Crow's rate limiter
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <src/crow_rate_limiter.hpp>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+namespace
+{
+std::int64_t now_ticks()
+{
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+/// parse a delay in seconds; returns a non-positive value for invalid input
+double parse_seconds(const std::string& value)
+{
+    char* end = nullptr;
+    const double result = std::strtod(value.c_str(), &end);
+    return (end != value.c_str() and not std::isnan(result)) ? result : -1.0;
+}
+}
+
+rate_limiter::rate_limiter()
+{
+    for (auto& deadline : m_deadlines)
+    {
+        deadline.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool rate_limiter::is_limited(const category cat) const
+{
+    return now_ticks() < deadline(cat);
+}
+
+std::chrono::steady_clock::time_point rate_limiter::limited_until(const category cat) const
+{
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(deadline(cat)));
+}
+
+std::int64_t rate_limiter::deadline(const category cat) const
+{
+    if (cat == category::unknown)
+    {
+        return 0;
+    }
+
+    const auto get = [this](const category c)
+    {
+        return m_deadlines[static_cast<std::size_t>(c)].load(std::memory_order_relaxed);
+    };
+
+    std::int64_t result = (std::max)(get(category::all), get(cat));
+
+    // events are classified as "error" or "default" by Sentry
+    if (cat == category::error or cat == category::default_type)
+    {
+        result = (std::max)(result, (std::max)(get(category::error), get(category::default_type)));
+    }
+
+    return result;
+}
+
+void rate_limiter::update(const int status_code,
+                          const std::string& retry_after,
+                          const std::string& rate_limits)
+{
+    if (not rate_limits.empty())
+    {
+        // comma-separated list of "retry_after:categories:scope:reason_code"
+        std::istringstream limits(rate_limits);
+        std::string limit_entry;
+        while (std::getline(limits, limit_entry, ','))
+        {
+            std::istringstream fields(limit_entry);
+            std::string seconds;
+            std::string categories;
+            std::getline(fields, seconds, ':');
+            std::getline(fields, categories, ':');
+
+            const double delay = parse_seconds(seconds);
+            if (delay <= 0)
+            {
+                continue;
+            }
+
+            // trim the categories; an empty list applies to all categories
+            categories.erase(0, categories.find_first_not_of(' '));
+            if (categories.empty())
+            {
+                limit(category::all, delay);
+                continue;
+            }
+
+            std::istringstream category_names(categories);
+            std::string name;
+            while (std::getline(category_names, name, ';'))
+            {
+                const auto cat = parse_category(name);
+                if (cat != category::unknown)
+                {
+                    limit(cat, delay);
+                }
+            }
+        }
+    }
+    else if (status_code == 429)
+    {
+        const double delay = parse_seconds(retry_after);
+        limit(category::all, delay > 0 ? delay : default_retry_after);
+    }
+}
+
+rate_limiter::category rate_limiter::parse_category(const std::string& name)
+{
+    if (name == "default")
+    {
+        return category::default_type;
+    }
+    if (name == "error")
+    {
+        return category::error;
+    }
+    if (name == "transaction")
+    {
+        return category::transaction;
+    }
+    if (name == "security")
+    {
+        return category::security;
+    }
+    if (name == "attachment")
+    {
+        return category::attachment;
+    }
+    if (name == "session")
+    {
+        return category::session;
+    }
+    return category::unknown;
+}
+
+void rate_limiter::limit(const category cat, const double seconds)
+{
+    // larger values would overflow the clock's ticks
+    const double clamped_seconds = seconds < max_delay ? seconds : max_delay;
+    const auto delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(clamped_seconds));
+    const auto new_deadline = now_ticks() + delay.count();
+    auto& deadline = m_deadlines[static_cast<std::size_t>(cat)];
+
+    // never shorten an existing limit
+    auto current = deadline.load(std::memory_order_relaxed);
+    while (current < new_deadline and not deadline.compare_exchange_weak(current, new_deadline, std::memory_order_relaxed))
+    {
+    }
+}
+
+}
+}
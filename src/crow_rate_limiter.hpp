@@ -0,0 +1,135 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef NLOHMANN_CROW_RATE_LIMITER_HPP
+#define NLOHMANN_CROW_RATE_LIMITER_HPP
+
+/*!
+ * @file crow_rate_limiter.hpp
+ * @brief client-side handling of Sentry's rate limits
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+/*!
+ * @brief rate limits announced by Sentry
+ *
+ * Keeps a deadline per data category until which Sentry rejects data of
+ * that category. Checking a limit is lock-free, so the capturing threads
+ * can do it before spending any work on an event.
+ *
+ * @see https://develop.sentry.dev/sdk/rate-limiting/
+ */
+class rate_limiter
+{
+  public:
+    /// data categories of Sentry's rate limits
+    enum class category : std::size_t
+    {
+        all,          ///< all categories (limit without categories)
+        default_type, ///< events with an unspecified type ("default")
+        error,        ///< error and message events ("error")
+        transaction,  ///< transactions ("transaction")
+        security,     ///< security reports ("security")
+        attachment,   ///< attachments ("attachment")
+        session,      ///< release health sessions ("session")
+        unknown       ///< a category this client does not know
+    };
+
+    rate_limiter();
+
+    /*!
+     * @brief whether data of a category is currently rate-limited
+     * @param[in] cat data category
+     * @return true if Sentry would reject the data
+     *
+     * @note Events are limited by both "error" and "default" limits.
+     */
+    bool is_limited(category cat) const;
+
+    /*!
+     * @brief return the time until which data of a category is rate-limited
+     * @param[in] cat data category
+     * @return the end of the latest limit that applies to @a cat; a time in
+     *         the past if the category is not limited
+     *
+     * @note Events are limited by both "error" and "default" limits.
+     */
+    std::chrono::steady_clock::time_point limited_until(category cat) const;
+
+    /*!
+     * @brief update the limits from a Sentry response
+     * @param[in] status_code HTTP status code of the response
+     * @param[in] retry_after value of the Retry-After header (may be empty)
+     * @param[in] rate_limits value of the X-Sentry-Rate-Limits header (may be empty)
+     */
+    void update(int status_code,
+                const std::string& retry_after,
+                const std::string& rate_limits);
+
+    /*!
+     * @brief return the category for a name used in X-Sentry-Rate-Limits
+     * @param[in] name category name
+     * @return category, or category::unknown
+     */
+    static category parse_category(const std::string& name);
+
+  private:
+    /// the deadline of the latest limit that applies to a category, as steady_clock ticks
+    std::int64_t deadline(category cat) const;
+
+    /// extend the limit of a category to the given number of seconds (at most max_delay) from now
+    void limit(category cat, double seconds);
+
+    /// the number of categories with a deadline
+    static constexpr std::size_t category_count = static_cast<std::size_t>(category::unknown);
+
+    /// the retry delay in seconds if Sentry sends a 429 without a usable delay
+    static constexpr double default_retry_after = 60.0;
+
+    /// the longest limit in seconds; longer delays sent by Sentry are shortened
+    static constexpr double max_delay = 86400.0;
+
+    /// deadlines as steady_clock ticks since its epoch (0: not limited)
+    std::atomic<std::int64_t> m_deadlines[category_count];
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file crow_scope.cpp
+ * @brief implementation of Crow's scope
+ */
+
+#include <src/crow_scope.hpp>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+const json& scope::get(const std::string& key) const
+{
+    static const json null_value;
+    const auto it = m_values.find(key);
+    return it != m_values.end() ? *it->second : null_value;
+}
+
+scope scope::with(const std::string& key, json value) const
+{
+    scope result = *this;
+    result.m_values[key] = std::make_shared<const json>(std::move(value));
+    return result;
+}
+
+json scope::to_json() const
+{
+    json result = json::object();
+    for (const auto& value : m_values)
+    {
+        result[value.first] = *value.second;
+    }
+    return result;
+}
+
+std::string scope::dump(const json& event) const
+{
+    std::string result = "{";
+
+    const auto add = [&result](const std::string& key, const json& value)
+    {
+        if (result.size() > 1)
+        {
+            result += ',';
+        }
+        result += json(key).dump();
+        result += ':';
+        result += value.dump();
+    };
+
+    // merge the sorted keys of the event and the scope
+    auto event_it = event.begin();
+    auto scope_it = m_values.begin();
+    while (event_it != event.end() or scope_it != m_values.end())
+    {
+        if (scope_it == m_values.end() or (event_it != event.end() and event_it.key() <= scope_it->first))
+        {
+            if (scope_it != m_values.end() and event_it.key() == scope_it->first)
+            {
+                // the event replaces the value of the scope
+                ++scope_it;
+            }
+            add(event_it.key(), event_it.value());
+            ++event_it;
+        }
+        else
+        {
+            add(scope_it->first, *scope_it->second);
+            ++scope_it;
+        }
+    }
+
+    result += '}';
+    return result;
+}
+
+}
+}
@@ -0,0 +1,98 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef NLOHMANN_CROW_SCOPE_HPP
+#define NLOHMANN_CROW_SCOPE_HPP
+
+/*!
+ * @file crow_scope.hpp
+ * @brief immutable context data shared between events
+ */
+
+#include <map>
+#include <memory>
+#include <string>
+#include <thirdparty/json/json.hpp>
+
+using json = nlohmann::json;
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+/*!
+ * @brief an immutable set of top-level payload values
+ *
+ * Each value (e.g., "user" or "contexts") is held by a reference-counted
+ * pointer. Modifying a value creates a new scope that shares all other
+ * values with the old one, so taking a snapshot of a scope only copies a
+ * pointer, and unchanged values are never copied.
+ */
+class scope
+{
+  public:
+    /*!
+     * @brief return a top-level value
+     * @param[in] key the key of the value
+     * @return the value, or null if the key is not set
+     */
+    const json& get(const std::string& key) const;
+
+    /*!
+     * @brief return a copy of this scope with a replaced value
+     * @param[in] key the key of the value
+     * @param[in] value the new value
+     * @return a scope that shares all other values with this scope
+     */
+    scope with(const std::string& key, json value) const;
+
+    /*!
+     * @brief return all values as one object
+     * @note Copies all values.
+     */
+    json to_json() const;
+
+    /*!
+     * @brief serialize an event with the values of this scope
+     * @param[in] event an object with the event's own values; they replace
+     *            values of this scope with the same key
+     * @return the serialized event
+     */
+    std::string dump(const json& event) const;
+
+  private:
+    /// the top-level values
+    std::map<std::string, std::shared_ptr<const json>> m_values;
+};
+
+}
+}
+
+#endif
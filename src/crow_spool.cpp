@@ -0,0 +1,396 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file crow_spool.cpp
+ * @brief implementation of Crow's on-disk spool
+ */
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <src/crow_config.hpp>
+#include <src/crow_spool.hpp>
+
+#ifdef NLOHMANN_CROW_HAVE_SYS_MMAN_H
+    #include <fcntl.h> // for open
+    #include <sys/file.h> // for flock
+    #include <sys/mman.h> // for mmap, msync, munmap
+    #include <sys/stat.h> // for fstat
+    #include <unistd.h> // for close, ftruncate
+#endif
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+struct spool::header
+{
+    /// file format identifier
+    char magic[8];
+    /// size of the data region
+    std::uint64_t capacity;
+    /// offset of the oldest record (or of a wrap marker) in the data region
+    std::uint64_t head;
+    /// offset behind the newest record in the data region
+    std::uint64_t tail;
+};
+
+namespace
+{
+/// the file format identifier
+const char spool_magic[8] = {'C', 'R', 'O', 'W', 'S', 'P', 'L', '1'};
+/// the size reserved for the header in front of the data region
+constexpr std::uint64_t header_size = 64;
+/// the size of a record's length and checksum fields
+constexpr std::uint64_t record_header_size = 8;
+/// length value marking that the next record starts at offset 0
+constexpr std::uint32_t wrap_marker = 0xFFFFFFFF;
+
+std::uint64_t padded(const std::uint64_t size)
+{
+    return (size + 7) & ~static_cast<std::uint64_t>(7);
+}
+
+/// 32-bit FNV-1a hash
+std::uint32_t checksum(const unsigned char* data, const std::size_t size)
+{
+    std::uint32_t result = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        result ^= data[i];
+        result *= 16777619u;
+    }
+    return result;
+}
+
+std::uint32_t load_u32(const unsigned char* ptr)
+{
+    std::uint32_t result;
+    std::memcpy(&result, ptr, sizeof(result));
+    return result;
+}
+
+void store_u32(unsigned char* ptr, const std::uint32_t value)
+{
+    std::memcpy(ptr, &value, sizeof(value));
+}
+}
+
+#ifdef NLOHMANN_CROW_HAVE_SYS_MMAN_H
+
+spool::spool(const std::string& path, const std::size_t capacity)
+{
+    static_assert(sizeof(header) <= header_size, "spool header too large");
+
+    m_file = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (m_file == -1)
+    {
+        throw std::runtime_error("cannot open spool file " + path);
+    }
+
+    // the records would be corrupted if two spools wrote to the file
+    if (::flock(m_file, LOCK_EX | LOCK_NB) != 0)
+    {
+        ::close(m_file);
+        throw std::runtime_error("spool file " + path + " is used by another spool");
+    }
+
+    // check whether the file is an existing spool
+    struct stat file_stat;
+    header existing;
+    bool valid = false;
+    if (::fstat(m_file, &file_stat) == 0 and static_cast<std::uint64_t>(file_stat.st_size) > header_size
+            and ::pread(m_file, &existing, sizeof(existing), 0) == static_cast<ssize_t>(sizeof(existing)))
+    {
+        valid = std::memcmp(existing.magic, spool_magic, sizeof(spool_magic)) == 0
+                and existing.capacity % 8 == 0
+                and header_size + existing.capacity == static_cast<std::uint64_t>(file_stat.st_size)
+                and existing.head < existing.capacity and existing.tail < existing.capacity;
+    }
+
+    m_capacity = valid ? existing.capacity : padded(capacity);
+    if (m_capacity < 2 * record_header_size)
+    {
+        ::close(m_file);
+        throw std::runtime_error("spool capacity too small");
+    }
+    m_mapping_size = static_cast<std::size_t>(header_size + m_capacity);
+
+    if (not valid and ::ftruncate(m_file, static_cast<off_t>(m_mapping_size)) != 0)
+    {
+        ::close(m_file);
+        throw std::runtime_error("cannot resize spool file " + path);
+    }
+
+    void* mapping = ::mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+    if (mapping == MAP_FAILED)
+    {
+        ::close(m_file);
+        throw std::runtime_error("cannot map spool file " + path);
+    }
+
+    m_mapping = static_cast<unsigned char*>(mapping);
+    m_header = reinterpret_cast<header*>(m_mapping);
+    m_data = m_mapping + header_size;
+
+    if (valid)
+    {
+        recover();
+    }
+    else
+    {
+        std::memset(m_mapping, 0, static_cast<std::size_t>(header_size));
+        m_header->capacity = m_capacity;
+        m_header->head = 0;
+        m_header->tail = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(m_header->magic, spool_magic, sizeof(spool_magic));
+    }
+}
+
+spool::~spool()
+{
+    ::msync(m_mapping, m_mapping_size, MS_ASYNC);
+    ::munmap(m_mapping, m_mapping_size);
+    ::close(m_file);
+}
+
+#else
+
+spool::spool(const std::string&, std::size_t)
+{
+    throw std::runtime_error("spool files are not supported on this platform");
+}
+
+spool::~spool() = default;
+
+#endif
+
+bool spool::push(const std::string& data)
+{
+    const std::uint64_t size = record_header_size + padded(data.size());
+    if (data.empty() or data.size() >= wrap_marker or size + record_header_size > m_capacity)
+    {
+        return false;
+    }
+
+    // make room by discarding the oldest records
+    while (not fits(size))
+    {
+        if (empty())
+        {
+            reset();
+            break;
+        }
+        pop();
+        ++m_discarded;
+    }
+
+    std::uint64_t offset = m_header->tail;
+    if (offset + size > m_capacity)
+    {
+        // the record does not fit at the end of the data region
+        store_u32(m_data + offset, wrap_marker);
+        offset = 0;
+    }
+
+    // write the record completely before it becomes visible
+    store_u32(m_data + offset, static_cast<std::uint32_t>(data.size()));
+    std::memcpy(m_data + offset + record_header_size, data.data(), data.size());
+    store_u32(m_data + offset + 4, checksum(m_data + offset + record_header_size, data.size()));
+
+    commit_tail((offset + size) % m_capacity);
+    ++m_count;
+    return true;
+}
+
+bool spool::front(std::string& data)
+{
+    if (empty())
+    {
+        return false;
+    }
+
+    const auto offset = read_offset();
+    if (record_size_at(offset) == 0)
+    {
+        // the file was modified behind our back; drop everything
+        commit_tail(m_header->head);
+        m_count = 0;
+        return false;
+    }
+
+    data.assign(reinterpret_cast<const char*>(m_data + offset + record_header_size),
+                load_u32(m_data + offset));
+    return true;
+}
+
+void spool::pop()
+{
+    if (empty())
+    {
+        return;
+    }
+
+    const auto offset = read_offset();
+    const auto size = record_size_at(offset);
+
+    // invalidate the record, so it is never read again after a crash
+    store_u32(m_data + offset, 0);
+
+    if (size == 0 or (offset + size) % m_capacity == m_header->tail)
+    {
+        // the spool is empty: start from the beginning to avoid wrapping
+        reset();
+    }
+    else
+    {
+        commit_head((offset + size) % m_capacity);
+        --m_count;
+    }
+}
+
+bool spool::empty() const noexcept
+{
+    return m_header->head == m_header->tail;
+}
+
+void spool::recover()
+{
+    m_count = 0;
+    std::uint64_t offset = m_header->head;
+    bool wrapped = false;
+
+    while (offset != m_header->tail)
+    {
+        if (load_u32(m_data + offset) == wrap_marker and not wrapped)
+        {
+            wrapped = true;
+            offset = 0;
+            continue;
+        }
+
+        const auto size = record_size_at(offset);
+        const auto end = offset + size;
+        const bool crosses_tail = offset < m_header->tail and end > m_header->tail;
+        if (size == 0 or crosses_tail or m_count > m_capacity / record_header_size)
+        {
+            // truncate at the first broken record
+            commit_tail(offset);
+            break;
+        }
+
+        offset = end % m_capacity;
+        if (offset == 0)
+        {
+            wrapped = true;
+        }
+        ++m_count;
+    }
+
+    if (m_count == 0)
+    {
+        reset();
+    }
+}
+
+void spool::reset()
+{
+    // All consumed records were invalidated by pop(), including the last
+    // record written to offset 0. Hence, a crash between the two steps
+    // leaves a state that recover() identifies as empty.
+    commit_head(0);
+    commit_tail(0);
+    m_count = 0;
+}
+
+std::uint64_t spool::record_size_at(const std::uint64_t offset) const
+{
+    if (offset + record_header_size > m_capacity)
+    {
+        return 0;
+    }
+
+    const auto length = load_u32(m_data + offset);
+    const auto size = record_header_size + padded(length);
+    if (length == 0 or length == wrap_marker or offset + size > m_capacity)
+    {
+        return 0;
+    }
+
+    if (load_u32(m_data + offset + 4) != checksum(m_data + offset + record_header_size, length))
+    {
+        return 0;
+    }
+
+    return size;
+}
+
+std::uint64_t spool::read_offset() const
+{
+    const auto head = m_header->head;
+    return (load_u32(m_data + head) == wrap_marker) ? 0 : head;
+}
+
+bool spool::fits(const std::uint64_t size) const
+{
+    const auto head = m_header->head;
+    const auto tail = m_header->tail;
+
+    if (tail < head)
+    {
+        // tail must not reach head, because head == tail means empty
+        return tail + size < head;
+    }
+
+    if (tail + size < m_capacity or (tail + size == m_capacity and head != 0))
+    {
+        return true;
+    }
+
+    // wrap around: the record starts at offset 0 and must end before head
+    return size < head;
+}
+
+void spool::commit_tail(const std::uint64_t tail)
+{
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->tail = tail;
+}
+
+void spool::commit_head(const std::uint64_t head)
+{
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->head = head;
+}
+
+}
+}
@@ -0,0 +1,167 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef NLOHMANN_CROW_SPOOL_HPP
+#define NLOHMANN_CROW_SPOOL_HPP
+
+/*!
+ * @file crow_spool.hpp
+ * @brief memory-mapped on-disk buffer for events that could not be sent
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+/*!
+ * @brief a ring buffer of serialized events in a memory-mapped file
+ *
+ * The file starts with a small header followed by the data region. Each
+ * record consists of its length, a checksum, and the data, padded to 8
+ * bytes. A record is written completely before the tail offset in the
+ * header is moved past it, and the head offset is only moved after a
+ * record was consumed. As both offsets are single aligned 8-byte words,
+ * a process crash leaves either the old or the new state behind. When the
+ * file is opened again, the records between head and tail are verified
+ * and the buffer is truncated at the first broken record.
+ *
+ * If a new record does not fit, the oldest records are discarded, so the
+ * file never grows beyond its initial size.
+ *
+ * The file is locked with flock() while it is open, so two processes (for
+ * instance during a restart) never write to it at the same time.
+ *
+ * @note The class is not thread-safe.
+ */
+class spool
+{
+  public:
+    /*!
+     * @brief open or create a spool file
+     *
+     * @param[in] path path of the spool file
+     * @param[in] capacity size of the data region in bytes (rounded up to 8); an
+     *            existing file keeps its capacity
+     *
+     * @throw std::runtime_error if the file cannot be opened or mapped, if it
+     *        is locked by another spool of this or another process, or if
+     *        memory-mapped files are not supported on this platform
+     */
+    spool(const std::string& path, std::size_t capacity);
+
+    ~spool();
+
+    spool(const spool&) = delete;
+    spool& operator=(const spool&) = delete;
+
+    /*!
+     * @brief append a record, discarding old records if required
+     * @param[in] data the record data
+     * @return whether the record was stored (false if it is larger than the spool)
+     */
+    bool push(const std::string& data);
+
+    /*!
+     * @brief read the oldest record
+     * @param[out] data the record data
+     * @return whether a record was available
+     */
+    bool front(std::string& data);
+
+    /*!
+     * @brief remove the oldest record
+     */
+    void pop();
+
+    /*!
+     * @brief return whether the spool contains no records
+     */
+    bool empty() const noexcept;
+
+    /*!
+     * @brief return the number of records in the spool
+     */
+    std::size_t size() const noexcept
+    {
+        return m_count;
+    }
+
+    /*!
+     * @brief return the number of records discarded because the spool was full
+     */
+    std::size_t discarded() const noexcept
+    {
+        return m_discarded;
+    }
+
+  private:
+    struct header;
+
+    /// verify the records between head and tail after opening the file
+    void recover();
+    /// return the size of the record at the given offset including padding, or 0 if it is broken
+    std::uint64_t record_size_at(std::uint64_t offset) const;
+    /// return the offset of the oldest record, following a wrap marker at head
+    std::uint64_t read_offset() const;
+    /// whether a record of the given size can be written without discarding records
+    bool fits(std::uint64_t size) const;
+    /// move head and tail of an empty spool to the beginning of the data region
+    void reset();
+    /// move the tail or head offset in the header
+    void commit_tail(std::uint64_t tail);
+    void commit_head(std::uint64_t head);
+
+  private:
+    /// file descriptor of the spool file
+    int m_file = -1;
+    /// the mapped file
+    unsigned char* m_mapping = nullptr;
+    /// size of the mapped file
+    std::size_t m_mapping_size = 0;
+    /// the header at the beginning of the mapping
+    header* m_header = nullptr;
+    /// the data region after the header
+    unsigned char* m_data = nullptr;
+    /// the size of the data region
+    std::uint64_t m_capacity = 0;
+    /// the number of records between head and tail
+    std::size_t m_count = 0;
+    /// the number of records discarded because the spool was full
+    std::size_t m_discarded = 0;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file crow_symbols.cpp
+ * @brief implementation of the symbol cache
+ */
+
+#include <cstdlib>
+#include <src/crow_config.hpp>
+#include <src/crow_elf.hpp>
+#include <src/crow_symbols.hpp>
+
+#ifdef NLOHMANN_CROW_HAVE_CXXABI_H
+    #include <cxxabi.h> // for abi::__cxa_demangle
+#endif
+
+#ifdef NLOHMANN_CROW_HAVE_DLFCN_H
+    #include <dlfcn.h> // for dladdr
+#endif
+
+#if defined(NLOHMANN_CROW_HAVE_DLFCN_H) && defined(NLOHMANN_CROW_HAVE_LINK_H)
+    #define NLOHMANN_CROW_FIND_MAIN_PROGRAM
+    #include <link.h> // for dl_iterate_phdr
+    #include <unistd.h> // for readlink
+#endif
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+#ifdef NLOHMANN_CROW_FIND_MAIN_PROGRAM
+namespace
+{
+/// the executable of the process
+struct main_program
+{
+    /// the address the executable is loaded at, as reported by dladdr
+    const void* load_address = nullptr;
+    /// the absolute path of the executable
+    std::string path;
+};
+
+/// callback for dl_iterate_phdr that stores the load address of the first object, the executable
+int find_main_program(dl_phdr_info* object, std::size_t /*size*/, void* data)
+{
+    Dl_info info;
+    if (object->dlpi_phnum > 0 and dladdr(object->dlpi_phdr, &info) != 0)
+    {
+        static_cast<main_program*>(data)->load_address = info.dli_fbase;
+    }
+    return 1;
+}
+
+/*!
+ * @brief return the executable of the process
+ *
+ * dladdr names the executable after argv[0], which is relative or only a
+ * file name if the program was started from another directory or via PATH.
+ */
+const main_program& get_main_program()
+{
+    static const main_program result = []
+    {
+        main_program program;
+        dl_iterate_phdr(&find_main_program, &program);
+
+        char path[4096];
+        const auto size = ::readlink("/proc/self/exe", path, sizeof(path));
+        program.path = (size > 0 and static_cast<std::size_t>(size) < sizeof(path))
+                       ? std::string(path, static_cast<std::size_t>(size))
+                       : std::string("/proc/self/exe");
+        return program;
+    }();
+    return result;
+}
+}
+#endif
+
+// https://gist.github.com/fmela/591333
+resolved_symbol resolve_symbol(const void* address)
+{
+    resolved_symbol result;
+
+#ifdef NLOHMANN_CROW_HAVE_DLFCN_H
+    Dl_info info;
+    if (dladdr(address, &info) == 0)
+    {
+        return result;
+    }
+
+    std::string module_path = info.dli_fname != nullptr ? info.dli_fname : "";
+    std::string file = module_path;
+#ifdef NLOHMANN_CROW_FIND_MAIN_PROGRAM
+    if (info.dli_fbase != nullptr and info.dli_fbase == get_main_program().load_address)
+    {
+        // the file of the executable is always reachable via /proc, even if it was replaced
+        module_path = get_main_program().path;
+        file = "/proc/self/exe";
+    }
+#endif
+
+    const char* name = info.dli_sname;
+    if (name == nullptr and not file.empty())
+    {
+        // dladdr only knows exported symbols, so look in the symbol tables of the file
+        const auto module = get_elf_module(file);
+        if (module)
+        {
+            name = module->find_function(reinterpret_cast<std::uintptr_t>(address),
+                                         reinterpret_cast<std::uintptr_t>(info.dli_fbase));
+        }
+    }
+
+    if (name != nullptr)
+    {
+        char* demangled = nullptr;
+        int status = -1;
+        if (name[0] == '_')
+        {
+#ifdef NLOHMANN_CROW_HAVE_CXXABI_H
+            demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+#endif
+        }
+
+        result.function = (status == 0 ? demangled : name);
+        free(demangled);
+
+        if (not module_path.empty())
+        {
+            result.module = std::move(module_path);
+            result.file = std::move(file);
+            result.load_address = reinterpret_cast<std::uintptr_t>(info.dli_fbase);
+        }
+
+        if (result.function.compare(0, 5, "std::") == 0 or result.function.compare(0, 2, "__") == 0)
+        {
+            result.in_app = false;
+        }
+    }
+#else
+    static_cast<void>(address);
+#endif
+
+    return result;
+}
+
+symbol_cache::symbol_cache(const std::size_t capacity)
+    : m_shard_capacity(capacity / shard_count > 0 ? capacity / shard_count : 1)
+{}
+
+symbol_cache::symbol_ptr symbol_cache::lookup(const void* address)
+{
+    const auto key = reinterpret_cast<std::uintptr_t>(address);
+    auto& s = shard_for(key);
+
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        const auto it = s.index.find(key);
+        if (it != s.index.end())
+        {
+            s.entries.splice(s.entries.begin(), s.entries, it->second);
+            return it->second->second;
+        }
+    }
+
+    // dladdr and demangling are slow, so other threads may use the shard meanwhile
+    auto symbol = std::make_shared<const resolved_symbol>(resolve_symbol(address));
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(key);
+    if (it != s.index.end())
+    {
+        // another thread resolved the address first
+        s.entries.splice(s.entries.begin(), s.entries, it->second);
+        return it->second->second;
+    }
+
+    if (s.entries.size() >= m_shard_capacity)
+    {
+        s.index.erase(s.entries.back().first);
+        s.entries.pop_back();
+    }
+
+    s.entries.emplace_front(key, symbol);
+    s.index.emplace(key, s.entries.begin());
+    return symbol;
+}
+
+void symbol_cache::clear()
+{
+    for (auto& s : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.index.clear();
+        s.entries.clear();
+    }
+}
+
+std::size_t symbol_cache::size() const
+{
+    std::size_t result = 0;
+    for (const auto& s : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        result += s.entries.size();
+    }
+    return result;
+}
+
+symbol_cache::shard& symbol_cache::shard_for(const std::uintptr_t address)
+{
+    // neighbouring return addresses should land in different shards
+    return m_shards[((address >> 4u) ^ (address >> 12u)) & (shard_count - 1)];
+}
+
+symbol_cache& get_symbol_cache()
+{
+    static symbol_cache cache;
+    return cache;
+}
+
+}
+}
@@ -0,0 +1,145 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef NLOHMANN_CROW_SYMBOLS_HPP
+#define NLOHMANN_CROW_SYMBOLS_HPP
+
+/*!
+ * @file crow_symbols.hpp
+ * @brief resolution of instruction addresses to functions
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace nlohmann
+{
+namespace crow_utilities
+{
+
+/*!
+ * @brief the function an instruction address belongs to
+ */
+struct resolved_symbol
+{
+    /// the demangled name of the function (empty: the address could not be resolved)
+    std::string function;
+    /// the path of the executable or shared library containing the address
+    std::string module;
+    /// the file to read the symbol tables of the module from ("/proc/self/exe" for the executable)
+    std::string file;
+    /// the address the module is loaded at
+    std::uintptr_t load_address = 0;
+    /// whether the function belongs to the application rather than the standard library
+    bool in_app = true;
+};
+
+/*!
+ * @brief resolve an instruction address without caching
+ * @param[in] address an instruction pointer from capture_backtrace()
+ * @return the function containing the address
+ * @note Functions that dladdr cannot name are looked up in the ELF symbol
+ *       tables of the module, see get_elf_module().
+ */
+resolved_symbol resolve_symbol(const void* address);
+
+/*!
+ * @brief a bounded cache of resolved symbols with LRU eviction
+ *
+ * The cache is split into shards by address, each with its own lock and
+ * LRU list, so threads symbolizing different frames rarely contend. Symbols
+ * are resolved outside of the locks. Unresolvable addresses are cached as
+ * well, so they are not looked up again.
+ */
+class symbol_cache
+{
+  public:
+    /// a shared, immutable resolved symbol
+    using symbol_ptr = std::shared_ptr<const resolved_symbol>;
+
+    /*!
+     * @param[in] capacity the maximal number of cached addresses
+     */
+    explicit symbol_cache(std::size_t capacity = 4096);
+
+    /*!
+     * @brief return the symbol of an address, resolving it on a cache miss
+     * @param[in] address an instruction pointer from capture_backtrace()
+     * @return the function containing the address
+     */
+    symbol_ptr lookup(const void* address);
+
+    /// remove all cached symbols
+    void clear();
+
+    /// the number of cached addresses
+    std::size_t size() const;
+
+  private:
+    /// the number of shards (a power of two)
+    static constexpr std::size_t shard_count = 16;
+
+    /// a part of the cache with its own lock
+    struct shard
+    {
+        /// a cached address and its symbol
+        using entry = std::pair<std::uintptr_t, symbol_ptr>;
+
+        /// the lock for entries and index
+        mutable std::mutex mutex;
+        /// the cached symbols, most recently used first
+        std::list<entry> entries;
+        /// the position of each cached address in entries
+        std::unordered_map<std::uintptr_t, std::list<entry>::iterator> index;
+    };
+
+    /// return the shard responsible for an address
+    shard& shard_for(std::uintptr_t address);
+
+    /// the maximal number of cached addresses per shard
+    const std::size_t m_shard_capacity;
+    /// the shards
+    shard m_shards[shard_count];
+};
+
+/*!
+ * @brief return the symbol cache shared by all clients
+ */
+symbol_cache& get_symbol_cache();
+
+}
+}
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ _____ _____ _____ _ _ _
+|     | __  |     | | | |  Crow - a Sentry client for C++
+|   --|    -|  |  | | | |  version 0.0.6
+|_____|__|__|_____|_____|  https://github.com/nlohmann/crow
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2018 Niels Lohmann <http://nlohmann.me>.
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*!
+ * @file crow_transports.cpp
+ * @brief implementation of the built-in transports
+ */
+
+#include <cstdio> // remove, rename
+#include <sstream> // istringstream
+#include <stdexcept> // runtime_error
+#include <crow/transports.hpp>
+#include <thirdparty/curl_wrapper/curl_wrapper.hpp>
+#include <thirdparty/json/json.hpp>
+
+namespace nlohmann
+{
+namespace crow_transports
+{
+
+void synchronous_transport::send(request req, completion_handler on_completion)
+{
+    m_completed.emplace_back(deliver(req), std::move(on_completion));
+}
+
+void synchronous_transport::perform(std::chrono::milliseconds)
+{
+    // handlers may send new requests
+    auto completed = std::move(m_completed);
+    m_completed.clear();
+
+    for (auto& result : completed)
+    {
+        if (result.second)
+        {
+            result.second(std::move(result.first));
+        }
+    }
+}
+
+std::size_t synchronous_transport::in_flight() const
+{
+    return m_completed.size();
+}
+
+void synchronous_transport::abort()
+{
+    // the requests were delivered already
+    perform(std::chrono::milliseconds(0));
+}
+
+struct http_transport::impl
+{
+    explicit impl(std::string unix_socket)
+        : unix_socket_path(std::move(unix_socket))
+        , multi(&share)
+    {}
+
+    /// the Unix domain socket to connect to (empty for TCP)
+    const std::string unix_socket_path;
+    /// the DNS cache, TLS sessions, and connections shared by all requests
+    curl_share share;
+    /// the event loop; keeps its handles alive between requests
+    curl_multi_wrapper multi;
+};
+
+http_transport::http_transport()
+    : m_impl(new impl(""))
+{}
+
+http_transport::http_transport(std::string unix_socket_path)
+    : m_impl(new impl(std::move(unix_socket_path)))
+{}
+
+http_transport::~http_transport() = default;
+
+void http_transport::send(request req, completion_handler on_completion)
+{
+    auto curl = m_impl->multi.acquire_handle();
+
+    if (not m_impl->unix_socket_path.empty())
+    {
+#if LIBCURL_VERSION_NUM >= 0x072800
+        curl->set_option(CURLOPT_UNIX_SOCKET_PATH, m_impl->unix_socket_path.c_str());
+#else
+        throw std::runtime_error("Unix domain sockets require libcurl 7.40.0 or later");
+#endif
+
+        // the relay accepts plain HTTP and makes the TLS connection to Sentry itself
+        if (req.url.compare(0, 8, "https://") == 0)
+        {
+            req.url.replace(0, 8, "http://");
+        }
+    }
+
+    curl->clear_headers();
+    curl->set_header(("X-Sentry-Auth: " + req.auth).c_str());
+    const std::string content_type_header = "Content-Type: " + req.content_type;
+
+    m_impl->multi.post(std::move(curl), req.url, req.body, true, content_type_header.c_str(),
+                       [on_completion](CURLcode result, curl_wrapper::response curl_response)
+    {
+        response result_response;
+        if (result == CURLE_OK)
+        {
+            result_response.status_code = curl_response.status_code;
+            result_response.body = std::move(curl_response.data);
+            result_response.headers = std::move(curl_response.headers);
+        }
+        on_completion(std::move(result_response));
+    });
+}
+
+void http_transport::perform(const std::chrono::milliseconds timeout)
+{
+    m_impl->multi.perform(static_cast<int>(timeout.count()));
+}
+
+std::size_t http_transport::in_flight() const
+{
+    return m_impl->multi.in_flight();
+}
+
+void http_transport::wakeup()
+{
+    m_impl->multi.wakeup();
+}
+
+void http_transport::abort()
+{
+    m_impl->multi.abort();
+}
+
+unix_socket_transport::unix_socket_transport(std::string path)
+    : http_transport(std::move(path))
+{}
+
+file_transport::file_transport(std::string path, const std::size_t max_bytes, const std::size_t max_files)
+    : m_path(std::move(path))
+    , m_max_bytes(max_bytes)
+    , m_max_files(max_files)
+    , m_file(m_path, std::ios::app | std::ios::binary)
+{
+    if (not m_file)
+    {
+        throw std::runtime_error("cannot open " + m_path);
+    }
+
+    m_file.seekp(0, std::ios::end);
+    m_size = static_cast<std::size_t>(m_file.tellp());
+}
+
+response file_transport::deliver(const request& req)
+{
+    const auto record_size = req.body.size() + 1;
+    if (m_size != 0 and m_size + record_size > m_max_bytes)
+    {
+        rotate();
+    }
+
+    if (not m_file.is_open())
+    {
+        m_file.clear();
+        m_file.open(m_path, std::ios::app | std::ios::binary);
+    }
+
+    response result;
+    if (m_file)
+    {
+        m_file.write(req.body.data(), static_cast<std::streamsize>(req.body.size()));
+        m_file.put('\n');
+        m_file.flush();
+        m_size += record_size;
+    }
+
+    if (m_file)
+    {
+        result.status_code = 200;
+    }
+    else
+    {
+        // try again with a fresh stream next time
+        m_file.clear();
+    }
+
+    return result;
+}
+
+void file_transport::rotate()
+{
+    m_file.close();
+
+    if (m_max_files == 0)
+    {
+        std::remove(m_path.c_str());
+    }
+    else
+    {
+        std::remove((m_path + "." + std::to_string(m_max_files)).c_str());
+        for (auto i = m_max_files; i > 1; --i)
+        {
+            std::rename((m_path + "." + std::to_string(i - 1)).c_str(),
+                        (m_path + "." + std::to_string(i)).c_str());
+        }
+        std::rename(m_path.c_str(), (m_path + ".1").c_str());
+    }
+
+    m_file.open(m_path, std::ios::app | std::ios::binary);
+    m_size = 0;
+}
+
+namespace
+{
+/*!
+ * @brief return the event id of the last event of a request body
+ * @param[in] body a serialized event or envelope
+ */
+std::string last_event_id(const std::string& body)
+{
+    std::string result;
+    std::istringstream stream(body);
+    std::string line;
+
+    // in envelopes, events are on separate lines
+    while (std::getline(stream, line))
+    {
+        const auto item = json::parse(line, nullptr, false);
+        if (item.is_object() and item.count("event_id") != 0 and item.count("sent_at") == 0)
+        {
+            result = item["event_id"].get<std::string>();
+        }
+    }
+
+    return result;
+}
+}
+
+void memory_transport::send(request req, completion_handler on_completion)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    response result;
+    result.status_code = m_status_code;
+    result.headers = m_headers;
+    if (m_status_code == 200)
+    {
+        result.body = json({{"id", last_event_id(req.body)}}).dump();
+    }
+
+    m_requests.push_back(std::move(req));
+    m_in_flight.emplace_back(std::move(result), std::move(on_completion));
+}
+
+void memory_transport::perform(const std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_perform_count;
+    if (m_held)
+    {
+        m_wakeup.wait_for(lock, timeout, [this] { return m_woken or not m_held; });
+        m_woken = false;
+        if (m_held)
+        {
+            return;
+        }
+    }
+
+    // handlers may send new requests
+    auto completed = std::move(m_in_flight);
+    m_in_flight.clear();
+    lock.unlock();
+
+    for (auto& result : completed)
+    {
+        if (result.second)
+        {
+            result.second(std::move(result.first));
+        }
+    }
+}
+
+std::size_t memory_transport::in_flight() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_in_flight.size();
+}
+
+void memory_transport::wakeup()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_woken = true;
+        ++m_wakeup_count;
+    }
+    m_wakeup.notify_all();
+}
+
+void memory_transport::abort()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto cancelled = std::move(m_in_flight);
+    m_in_flight.clear();
+    lock.unlock();
+
+    for (auto& result : cancelled)
+    {
+        if (result.second)
+        {
+            result.second(response());
+        }
+    }
+}
+
+void memory_transport::set_response(const int status_code,
+                                    std::map<std::string, std::string> headers)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_status_code = status_code;
+    m_headers = std::move(headers);
+}
+
+void memory_transport::hold(const bool held)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_held = held;
+    }
+    m_wakeup.notify_all();
+}
+
+std::vector<request> memory_transport::requests() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requests;
+}
+
+std::size_t memory_transport::request_count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requests.size();
+}
+
+std::size_t memory_transport::wakeup_count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_wakeup_count;
+}
+
+std::size_t memory_transport::perform_count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_perform_count;
+}
+
+void memory_transport::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests.clear();
+}
+
+}
+}
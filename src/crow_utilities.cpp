@@ -32,20 +32,25 @@ SOFTWARE.
  * @brief implementation of Crow helper functions
  */
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
 #include <ctime>
+#include <limits>
 #include <typeinfo>
+#include <utility>
 #include <src/crow_config.hpp>
+#include <src/crow_dwarf.hpp>
+#include <src/crow_symbols.hpp>
 #include <src/crow_utilities.hpp>
 
-#ifndef NLOHMANN_CROW_MINGW
-    #include <random>
-#else
-    #include <cstdlib> // for srand, rand
-    #include <ctime> // for time
+#include <random>
+
+#ifdef NLOHMANN_CROW_HAVE_CLOCK_REALTIME_COARSE
+    #include <time.h> // for clock_gettime
 #endif
 
 #ifdef NLOHMANN_CROW_HAVE_CXXABI_H
@@ -56,74 +61,149 @@ SOFTWARE.
     #include <execinfo.h> // for backtrace
 #endif
 
-#ifdef NLOHMANN_CROW_HAVE_DLFCN_H
-    #include <dlfcn.h> // for dladdr
-#endif
-
 namespace nlohmann
 {
 
 namespace crow_utilities
 {
 
-// https://gist.github.com/fmela/591333
-// This function produces a stack backtrace with demangled function & method names.
-json get_backtrace(int skip)
+namespace
 {
-    json result = json::array();
-
-#if defined(NLOHMANN_CROW_HAVE_DLFCN_H) && defined(NLOHMANN_CROW_HAVE_EXECINFO_H)
-    void* callstack[128];
-    const int nMaxFrames = sizeof(callstack) / sizeof(callstack[0]);
-    char buf[1024];
-    int nFrames = backtrace(callstack, nMaxFrames);
-    char** symbols = backtrace_symbols(callstack, nFrames);
+/*!
+ * @brief the xoshiro256** generator
+ *
+ * A fast generator with a state of 256 bits that is good enough for sampling
+ * and UUIDs, but not for cryptography.
+ *
+ * @see http://prng.di.unimi.it
+ */
+class xoshiro256
+{
+  public:
+    using result_type = std::uint64_t;
 
-    for (int i = skip; i < nFrames; i++)
+    /// seed the state from a single value with splitmix64
+    explicit xoshiro256(std::uint64_t seed) noexcept
     {
-        Dl_info info;
-        if (dladdr(callstack[i], &info) && info.dli_sname)
+        for (auto& s : m_state)
         {
-            char* demangled = nullptr;
-            int status = -1;
-            if (info.dli_sname[0] == '_')
-            {
-#ifdef NLOHMANN_CROW_HAVE_CXXABI_H
-                demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            seed += 0x9e3779b97f4a7c15ull;
+            std::uint64_t z = seed;
+            z = (z ^ (z >> 30u)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27u)) * 0x94d049bb133111ebull;
+            s = z ^ (z >> 31u);
+        }
+    }
+
+    static constexpr result_type min() noexcept
+    {
+        return 0;
+    }
+
+    static constexpr result_type max() noexcept
+    {
+        return (std::numeric_limits<result_type>::max)();
+    }
+
+    result_type operator()() noexcept
+    {
+        const std::uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+        const std::uint64_t t = m_state[1] << 17u;
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+
+        return result;
+    }
+
+  private:
+    static std::uint64_t rotl(const std::uint64_t x, const int k) noexcept
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    /// the state
+    std::uint64_t m_state[4];
+};
+
+/*!
+ * @brief return the generator of the calling thread
+ *
+ * @note The C++11 random_device is broken in MinGW, so the generator is
+ *       seeded from the time and the thread there.
+ */
+xoshiro256& get_generator()
+{
+#ifdef NLOHMANN_CROW_MINGW
+    thread_local std::uint64_t seed_address = 0;
+    thread_local xoshiro256 generator(static_cast<std::uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())
+                                      ^ reinterpret_cast<std::uintptr_t>(&seed_address));
+#else
+    thread_local xoshiro256 generator((static_cast<std::uint64_t>(std::random_device{}()) << 32u) ^ std::random_device{}());
+#endif
+    return generator;
+}
+}
+
+std::vector<void*> capture_backtrace(int skip)
+{
+    std::vector<void*> result;
+
+#ifdef NLOHMANN_CROW_HAVE_EXECINFO_H
+    void* callstack[128];
+    const int frames = backtrace(callstack, sizeof(callstack) / sizeof(callstack[0]));
+    if (frames > skip)
+    {
+        result.assign(callstack + skip, callstack + frames);
+    }
+#else
+    static_cast<void>(skip);
 #endif
-            }
 
-            const std::string function_name = (status == 0 ? demangled : info.dli_sname == nullptr ? symbols[i] : info.dli_sname);
+    return result;
+}
+
+json symbolize_backtrace(const std::vector<void*>& backtrace, const bool source_lines)
+{
+    json result = json::array();
+    auto& cache = get_symbol_cache();
 
-            snprintf(buf, sizeof(buf), "%-3d %*p %s + %zd\n",
-                     i, int(2 + sizeof(void*) * 2), callstack[i],
-                     function_name.c_str(),
-                     (char*) callstack[i] - (char*) info.dli_saddr);
-            //std::cout << buf << std::endl;
+    for (void* address : backtrace)
+    {
+        const auto symbol = cache.lookup(address);
+        if (symbol->function.empty())
+        {
+            continue;
+        }
 
-            json entry;
-            entry["function"] = function_name;
+        json entry;
+        entry["function"] = symbol->function;
 
-            if (not function_name.empty())
+        if (source_lines and not symbol->file.empty())
+        {
+            const auto lines = get_line_table(symbol->file);
+            if (lines)
             {
-                if (function_name.substr(0, 5) == "std::" or function_name.substr(0, 2) == "__")
+                const auto location = lines->find(reinterpret_cast<std::uintptr_t>(address), symbol->load_address);
+                if (location.line != 0)
                 {
-                    entry["in_app"] = false;
+                    entry["filename"] = location.filename;
+                    entry["lineno"] = location.line;
                 }
             }
-
-            result.push_back(entry);
-
-            free(demangled);
         }
-        else
+
+        if (not symbol->in_app)
         {
-            snprintf(buf, sizeof(buf), "%-3d %*p %s\n",
-                     i, int(2 + sizeof(void*) * 2), callstack[i], symbols[i]);
+            entry["in_app"] = false;
         }
+
+        result.push_back(std::move(entry));
     }
-    free(symbols);
-#endif
 
     return result;
 }
@@ -152,55 +232,109 @@ std::int64_t get_timestamp()
 
 std::string get_iso8601()
 {
-    std::time_t now;
-    std::time(&now);
-    char buf[sizeof "2011-10-08T07:07:09Z"];
-    std::strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
-    return buf;
+#ifdef NLOHMANN_CROW_HAVE_CLOCK_REALTIME_COARSE
+    // the coarse clock is precise to a few milliseconds, but much cheaper to read
+    timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    return format_iso8601(static_cast<std::int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000);
+#else
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    return format_iso8601(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+#endif
 }
 
-int get_random_number(int lower, int upper)
+std::string format_iso8601(const std::int64_t milliseconds)
 {
-#ifdef NLOHMANN_CROW_MINGW
-    static bool init = false;
-    if (not init)
+    // ISO 8601 needs an extension for other years; keep the string length fixed
+    const std::int64_t first_millisecond = -62167219200000; // 0000-01-01T00:00:00.000Z
+    const std::int64_t last_millisecond = 253402300799999; // 9999-12-31T23:59:59.999Z
+    const std::int64_t time = (std::min)((std::max)(milliseconds, first_millisecond), last_millisecond);
+
+    // floor division, so times before the epoch are formatted correctly
+    const std::int64_t seconds = time / 1000 - (time % 1000 < 0 ? 1 : 0);
+    const auto millisecond = static_cast<int>(time - seconds * 1000);
+
+    // the date and time only change once per second, so each thread caches them
+    thread_local std::int64_t cached_seconds = 0;
+    thread_local char cached_prefix[sizeof "2011-10-08T07:07:09"] = "";
+    if (cached_seconds != seconds or cached_prefix[0] == '\0')
     {
-        init = true;
-        std::srand(std::time(nullptr));
+        // https://howardhinnant.github.io/date_algorithms.html#civil_from_days
+        const std::int64_t days = seconds / 86400 - (seconds % 86400 < 0 ? 1 : 0);
+        const std::int64_t second_of_day = seconds - days * 86400;
+        const std::int64_t z = days + 719468;
+        const std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        const std::int64_t doe = z - era * 146097;
+        const std::int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const std::int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const std::int64_t mp = (5 * doy + 2) / 153;
+        const std::int64_t day = doy - (153 * mp + 2) / 5 + 1;
+        const std::int64_t month = mp < 10 ? mp + 3 : mp - 9;
+        const std::int64_t year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+
+        // the buffer fits any int values, so the compiler can prove there is no truncation
+        char buffer[6 * sizeof "-2147483648"];
+        std::snprintf(buffer, sizeof buffer, "%04d-%02d-%02dT%02d:%02d:%02d",
+                      static_cast<int>(year), static_cast<int>(month), static_cast<int>(day),
+                      static_cast<int>(second_of_day / 3600), static_cast<int>(second_of_day / 60 % 60), static_cast<int>(second_of_day % 60));
+        std::memcpy(cached_prefix, buffer, sizeof cached_prefix - 1);
+        cached_prefix[sizeof cached_prefix - 1] = '\0';
+        cached_seconds = seconds;
     }
-    return std::rand() % upper + lower;
-#else
-    std::random_device random_device;
-    std::default_random_engine random_engine(random_device());
+
+    char result[sizeof "2011-10-08T07:07:09.123Z"];
+    std::memcpy(result, cached_prefix, sizeof cached_prefix - 1);
+    char* suffix = result + sizeof cached_prefix - 1;
+    suffix[0] = '.';
+    suffix[1] = static_cast<char>('0' + millisecond / 100);
+    suffix[2] = static_cast<char>('0' + millisecond / 10 % 10);
+    suffix[3] = static_cast<char>('0' + millisecond % 10);
+    suffix[4] = 'Z';
+    return std::string(result, sizeof result - 1);
+}
+
+int get_random_number(int lower, int upper)
+{
     std::uniform_int_distribution<int> uniform_dist(lower, upper);
-    return uniform_dist(random_engine);
-#endif
+    return uniform_dist(get_generator());
 }
 
 std::string generate_uuid()
 {
-    std::string result(32, ' ');
+    static const char hex_digits[] = "0123456789abcdef";
+
+    // 128 random bits, with the version (4) and variant (10xx) bits of RFC 4122
+    auto& generator = get_generator();
+    std::uint64_t bits[2] = {generator(), generator()};
+    bits[0] = (bits[0] & 0xffffffffffff0fffull) | 0x0000000000004000ull;
+    bits[1] = (bits[1] & 0x3fffffffffffffffull) | 0x8000000000000000ull;
 
-    for (std::size_t i = 0; i < result.size(); ++i)
+    std::string result(32, '0');
+    for (std::size_t i = 0; i < 16; ++i)
     {
-        // the 12th character must be a '4'
-        if (i == 12)
-        {
-            result[i] = '4';
-        }
-        else
-        {
-            // get a random number from 0..15
-            const auto r = static_cast<char>(get_random_number(0, 15));
-            if (r < 10)
-            {
-                result[i] = '0' + r;
-            }
-            else
-            {
-                result[i] = 'a' + r - static_cast<char>(10);
-            }
-        }
+        const auto byte = static_cast<std::uint8_t>(bits[i / 8] >> (56u - 8u * (i % 8)));
+        result[2 * i] = hex_digits[byte >> 4u];
+        result[2 * i + 1] = hex_digits[byte & 0x0fu];
+    }
+
+    return result;
+}
+
+
+std::string make_envelope(const std::vector<std::string>& events)
+{
+    const json header = {{"sent_at", get_iso8601()}};
+
+    std::string result = header.dump();
+    result += '\n';
+
+    for (const auto& event : events)
+    {
+        const json item_header = {{"type", "event"}, {"length", event.size()}};
+        result += item_header.dump();
+        result += '\n';
+        result += event;
+        result += '\n';
     }
 
     return result;
@@ -37,6 +37,7 @@ SOFTWARE.
 
 #include <cstdint>
 #include <string>
+#include <vector>
 #include <thirdparty/json/json.hpp>
 
 using json = nlohmann::json;
@@ -49,7 +50,25 @@ namespace nlohmann
 namespace crow_utilities
 {
 
-json get_backtrace(int skip = 1);
+/*!
+ * @brief record the instruction pointers of the calling thread's stack
+ * @param[in] skip the number of innermost frames to skip (default: this function)
+ * @return the instruction pointers, innermost first
+ * @note Does not resolve symbols, so it is cheap enough for capturing threads.
+ */
+std::vector<void*> capture_backtrace(int skip = 1);
+
+/*!
+ * @brief resolve the functions of a stack trace
+ * @param[in] backtrace instruction pointers from capture_backtrace()
+ * @param[in] source_lines whether to add file names and line numbers from
+ *            the DWARF line tables of the modules (default: off)
+ * @return the frames of the stack trace for Sentry; addresses without symbol are skipped
+ * @note Resolved addresses are cached, see get_symbol_cache().
+ * @note The first lookup of a line number in a module reads all its line
+ *       tables, which may take long for large modules.
+ */
+json symbolize_backtrace(const std::vector<void*>& backtrace, bool source_lines = false);
 
 /*!
  * @brief return pretty type name
@@ -66,7 +85,7 @@ std::string pretty_name(const char* type_id_name,
  * @param[in] upper upper bound
  * @return lower <= x <= upper
  *
- * @note The C++11 random implementation is broken in MinGW, so we need to fall back to std::rand().
+ * @note Uses a generator per thread that is seeded once.
  */
 int get_random_number(int lower, int upper);
 
@@ -78,16 +97,36 @@ std::int64_t get_timestamp();
 
 /*!
  * @brief get the current date and time as ISO 8601 string
- * @return ISO 8601 string
+ * @return ISO 8601 string with milliseconds, e.g. "2011-10-08T07:07:09.123Z"
+ * @note Uses CLOCK_REALTIME_COARSE where available.
  */
 std::string get_iso8601();
 
+/*!
+ * @brief format a time as ISO 8601 string
+ * @param[in] milliseconds milliseconds since epoch
+ * @return ISO 8601 string with milliseconds, e.g. "2011-10-08T07:07:09.123Z"
+ * @note The date and time of the last second are cached per thread.
+ * @note Times outside the years 0000..9999 are clamped to the first or last
+ *       millisecond of that range, so the string always has 24 characters.
+ */
+std::string format_iso8601(std::int64_t milliseconds);
+
 /*!
  * @brief generate a UUID4 without dashes
  * @return UUID4
+ * @note Draws 128 bits from the generator of the calling thread.
  */
 std::string generate_uuid();
 
+/*!
+ * @brief serialize events as Sentry envelope
+ * @param[in] events the serialized event payloads
+ * @return envelope with one "event" item per event
+ * @see https://develop.sentry.dev/sdk/envelopes/
+ */
+std::string make_envelope(const std::vector<std::string>& events);
+
 }
 }
 
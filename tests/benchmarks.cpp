@@ -0,0 +1,120 @@
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <random>
+#include <string>
+#include <src/crow_symbols.hpp>
+#include <src/crow_utilities.hpp>
+
+namespace
+{
+/// a sink for benchmark results so the compiler cannot discard them
+std::size_t sink = 0;
+
+/*!
+ * @brief run a function repeatedly and print the time per call
+ * @param[in] name the name of the benchmark
+ * @param[in] iterations the number of calls
+ * @param[in] function the function to measure
+ */
+void benchmark(const char* name, const std::size_t iterations, const std::function<void()>& function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        function();
+    }
+    const auto duration = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    std::printf("%-32s %12.1f ns\n", name, duration.count() / static_cast<double>(iterations));
+}
+
+/// get_random_number() of Crow 0.0.6, for comparison
+int legacy_get_random_number(int lower, int upper)
+{
+    std::random_device random_device;
+    std::default_random_engine random_engine(random_device());
+    std::uniform_int_distribution<int> uniform_dist(lower, upper);
+    return uniform_dist(random_engine);
+}
+
+/// generate_uuid() of Crow 0.0.6, for comparison
+std::string legacy_generate_uuid()
+{
+    std::string result(32, ' ');
+
+    for (std::size_t i = 0; i < result.size(); ++i)
+    {
+        if (i == 12)
+        {
+            result[i] = '4';
+        }
+        else
+        {
+            const auto r = static_cast<char>(legacy_get_random_number(0, 15));
+            result[i] = r < 10 ? static_cast<char>('0' + r) : static_cast<char>('a' + r - 10);
+        }
+    }
+
+    return result;
+}
+
+/// get_iso8601() of Crow 0.0.6, for comparison
+std::string legacy_get_iso8601()
+{
+    std::time_t now;
+    std::time(&now);
+    char buf[sizeof "2011-10-08T07:07:09Z"];
+    std::strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return buf;
+}
+}
+
+int main()
+{
+    benchmark("get_random_number (0.0.6)", 10000, []
+    {
+        sink += static_cast<std::size_t>(legacy_get_random_number(0, 99));
+    });
+    benchmark("get_random_number", 1000000, []
+    {
+        sink += static_cast<std::size_t>(nlohmann::crow_utilities::get_random_number(0, 99));
+    });
+
+    benchmark("generate_uuid (0.0.6)", 1000, []
+    {
+        sink += legacy_generate_uuid().size();
+    });
+    benchmark("generate_uuid", 1000000, []
+    {
+        sink += nlohmann::crow_utilities::generate_uuid().size();
+    });
+
+    benchmark("get_iso8601 (0.0.6)", 1000000, []
+    {
+        sink += legacy_get_iso8601().size();
+    });
+    benchmark("get_iso8601", 1000000, []
+    {
+        sink += nlohmann::crow_utilities::get_iso8601().size();
+    });
+
+    const auto backtrace = nlohmann::crow_utilities::capture_backtrace();
+    benchmark("resolve stack trace (uncached)", 1000, [&backtrace]
+    {
+        for (void* address : backtrace)
+        {
+            sink += nlohmann::crow_utilities::resolve_symbol(address).function.size();
+        }
+    });
+    benchmark("symbolize_backtrace", 1000, [&backtrace]
+    {
+        sink += nlohmann::crow_utilities::symbolize_backtrace(backtrace).size();
+    });
+    benchmark("symbolize_backtrace with lines", 1000, [&backtrace]
+    {
+        sink += nlohmann::crow_utilities::symbolize_backtrace(backtrace, true).size();
+    });
+
+    return sink == 0 ? 1 : 0;
+}